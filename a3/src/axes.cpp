@@ -60,7 +60,7 @@ Axes::Axes()
   // VAO
 
   glGenVertexArrays( 1, &VAO );
-  glBindVertexArray( VAO );
+  GPUProgram::bindVAO( VAO );
 
   // Positions
 
@@ -78,6 +78,8 @@ Axes::Axes()
   glEnableVertexAttribArray( 1 );
   glVertexAttribPointer( 1, 3, GL_FLOAT, GL_FALSE, 0, 0 );
 
+  GPUProgram::bindVAO( 0 );
+
   // Shaders
 
   program.init( vertShader, fragShader, "axes" );
@@ -95,13 +97,13 @@ void Axes::draw( mat4 &MVP, vec3 lightDir )
 
   program.activate();
 
-  glUniformMatrix4fv( glGetUniformLocation( program.id(), "MVP"), 1, GL_TRUE, &MVP[0][0] );
+  program.setMat4( "MVP", MVP );
 
 #ifndef MACOS
   glLineWidth( 3.0 );
 #endif
   
-  glBindVertexArray( VAO );
+  GPUProgram::bindVAO( VAO );
   glDrawArrays( GL_LINES, 0, 6 );
 
 #ifndef MACOS
@@ -11,48 +11,111 @@
 #include "drawSegs.h"
 
 
-// 'nSegs' is the number of segments.
-// 'segs' is an array of nSegs vertices.
+#define MIN_SEGS_CAPACITY 256
 
-void Segs::drawSegs( GLuint primitiveType, vec3 *pts, vec4 *colours, vec3 *norms, int nPts, mat4 &MV, mat4 &MVP, vec3 lightDir )
+
+// Make the VAO and its (so far empty) buffers
+
+void Segs::setupVAO()
 
 {
-  GLuint VAO;
-  
   glGenVertexArrays( 1, &VAO );
-  glBindVertexArray( VAO );
-
-  GLuint VBO0, VBO1, VBO2;
+  GPUProgram::bindVAO( VAO );
 
-  // Set up points
-  
-  glGenBuffers( 1, &VBO0 );
-  glBindBuffer( GL_ARRAY_BUFFER, VBO0 );
-  glBufferData( GL_ARRAY_BUFFER, nPts * sizeof(vec3), pts, GL_STATIC_DRAW );
+  glGenBuffers( 1, &pointBufferID );
+  glBindBuffer( GL_ARRAY_BUFFER, pointBufferID );
   glVertexAttribPointer( 0, 3, GL_FLOAT, GL_FALSE, 0, 0 );
   glEnableVertexAttribArray( 0 );
 
-  // Set up colours
-  
-  glGenBuffers( 1, &VBO1 );
-  glBindBuffer( GL_ARRAY_BUFFER, VBO1 );
-  glBufferData( GL_ARRAY_BUFFER, nPts * sizeof(vec4), colours, GL_STATIC_DRAW );
+  glGenBuffers( 1, &colourBufferID );
+  glBindBuffer( GL_ARRAY_BUFFER, colourBufferID );
   glVertexAttribPointer( 1, 4, GL_FLOAT, GL_FALSE, 0, 0 );
-  glEnableVertexAttribArray( 1 );
 
-  // Set up normals (or copy points to normals if normals are not provided, just to have some data there)
-
-  glGenBuffers( 1, &VBO2 );
-  glBindBuffer( GL_ARRAY_BUFFER, VBO2 );
-  glBufferData( GL_ARRAY_BUFFER, nPts * sizeof(vec3), (norms != NULL ? norms : pts), GL_STATIC_DRAW );
+  glGenBuffers( 1, &normalBufferID );
+  glBindBuffer( GL_ARRAY_BUFFER, normalBufferID );
   glVertexAttribPointer( 2, 3, GL_FLOAT, GL_FALSE, 0, 0 );
-  glEnableVertexAttribArray( 2 );
+
+  glBindBuffer( GL_ARRAY_BUFFER, 0 );
+  GPUProgram::bindVAO( 0 );
+
+  capacity = 0;
+}
+
+
+Segs::~Segs()
+
+{
+  GPUProgram::bindVAO( 0 );
+
+  glDeleteBuffers( 1, &pointBufferID );
+  glDeleteBuffers( 1, &colourBufferID );
+  glDeleteBuffers( 1, &normalBufferID );
+  glDeleteVertexArrays( 1, &VAO );
+
+  delete gpuProg;
+}
+
+
+// Upload n elements into a buffer.  The buffer's storage is
+// re-specified first ("orphaned") so that the driver can give it new
+// memory rather than wait for an earlier draw to finish reading it.
+
+void Segs::upload( GLuint bufferID, void *data, int elementSize, int n )
+
+{
+  glBindBuffer( GL_ARRAY_BUFFER, bufferID );
+  glBufferData( GL_ARRAY_BUFFER, capacity * elementSize, NULL, GL_STREAM_DRAW );
+  glBufferSubData( GL_ARRAY_BUFFER, 0, n * elementSize, data );
+}
+
+
+// 'nPts' is the number of points in 'pts'.
+//
+// If 'colours' is NULL, every point gets 'colour'.  If 'norms' is
+// NULL, no lighting is done.
+
+void Segs::draw( GLuint primitiveType, vec3 *pts, vec4 *colours, vec4 colour, vec3 *norms, int nPts, mat4 &MV, mat4 &MVP, vec3 lightDir )
+
+{
+  if (nPts <= 0)
+    return;
+
+  GPUProgram::bindVAO( VAO );
+
+  // Grow the buffers by doubling
+
+  while (capacity < nPts)
+    capacity = (capacity > 0 ? 2 * capacity : MIN_SEGS_CAPACITY);
+
+  // Set up points
+
+  upload( pointBufferID, pts, sizeof(vec3), nPts );
+
+  // Set up colours, or a constant colour for all points
+
+  if (colours != NULL) {
+    upload( colourBufferID, colours, sizeof(vec4), nPts );
+    glEnableVertexAttribArray( 1 );
+  } else {
+    glDisableVertexAttribArray( 1 );
+    glVertexAttrib4fv( 1, &colour[0] );
+  }
+
+  // Set up normals.  These are not used without 'norms', so a
+  // constant is given.
+
+  if (norms != NULL) {
+    upload( normalBufferID, norms, sizeof(vec3), nPts );
+    glEnableVertexAttribArray( 2 );
+  } else {
+    glDisableVertexAttribArray( 2 );
+    glVertexAttrib3f( 2, 0, 0, 1 );
+  }
+
+  glBindBuffer( GL_ARRAY_BUFFER, 0 );
 
   // Draw
 
-  GLint id = 0;
-  glGetIntegerv(GL_CURRENT_PROGRAM, &id); // get previously-active GPU program
- 
   gpuProg->activate();
 
   gpuProg->setMat4( "MV",  MV  );
@@ -63,24 +126,7 @@ void Segs::drawSegs( GLuint primitiveType, vec3 *pts, vec4 *colours, vec3 *norms
 
   glDrawArrays( primitiveType, 0, nPts );
 
-  gpuProg->deactivate();
-
-  glUseProgram( id ); // restore previously-active GPU program
-
-  // Clean up
-  
-  glDeleteBuffers( 1, &VBO0 );
-  glDeleteBuffers( 1, &VBO1 );
-  glDeleteBuffers( 1, &VBO2 );
-
-  glDisableVertexAttribArray( 0 );
-  glDisableVertexAttribArray( 1 );
-  glDisableVertexAttribArray( 2 );
-
-  glBindBuffer( GL_ARRAY_BUFFER, 0 );
-
-  glBindVertexArray( 0 );
-  glDeleteVertexArrays( 1, &VAO );
+  gpuProg->deactivate(); // (restores the previously-active GPU program)
 }
 
 
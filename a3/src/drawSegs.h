@@ -6,7 +6,12 @@
 //
 // Use it:
 //
-//    segs->drawOneSeg( tail, head, MVP );
+//    segs->drawSegs( GL_LINES, pts, colour, NULL, nPts, MV, MVP, lightDir );
+//
+// The VAO and vertex buffers are made once and kept.  Each draw
+// re-specifies ("orphans") the buffers and uploads into them, so a
+// draw creates no GL objects and does no heap allocation once the
+// buffers have grown to the largest number of points drawn so far.
 
 
 #ifndef DRAW_SEGS_H
@@ -22,30 +27,38 @@ class Segs {
   static const char *vertexShader;
 
   GPUProgram *setupShaders();
+  void setupVAO();
 
   GPUProgram *gpuProg;
-  
+
+  GLuint VAO;
+  GLuint pointBufferID, colourBufferID, normalBufferID;
+  int    capacity;  // of each buffer, in points
+
+  void upload( GLuint bufferID, void *data, int elementSize, int n );
+
+  void draw( GLuint primitiveType, vec3 *pts, vec4 *colours, vec4 colour, vec3 *norms, int nPts, mat4 &MV, mat4 &MVP, vec3 lightDir );
+
  public:
 
   Segs() { 
     gpuProg = setupShaders();
+    setupVAO();
   };
 
+  ~Segs();
+
   // Main function
   
-  void drawSegs( GLuint primitiveType, vec3 *pts, vec4 *colours, vec3 *norms, int nPts, mat4 &MV, mat4 &MVP, vec3 lightDir );
+  void drawSegs( GLuint primitiveType, vec3 *pts, vec4 *colours, vec3 *norms, int nPts, mat4 &MV, mat4 &MVP, vec3 lightDir ) {
+    draw( primitiveType, pts, colours, vec4(0,0,0,0), norms, nPts, MV, MVP, lightDir );
+  }
 
-  // Variant: single colour
+  // Variant: single colour, which is sent as a constant vertex
+  // attribute rather than copied to every point
   
   void drawSegs( GLuint primitiveType, vec3 *pts, vec4 colour, vec3 *norms, int nPts, mat4 &MV, mat4 &MVP, vec3 lightDir ) {
-
-    vec4 *colours = new vec4[ nPts ];
-    for (int i=0; i<nPts; i++)
-      colours[i] = colour;
-
-    drawSegs( primitiveType, pts, colours, norms, nPts, MV, MVP, lightDir );    
-
-    delete[] colours;
+    draw( primitiveType, pts, NULL, colour, norms, nPts, MV, MVP, lightDir );
   }
 };
 
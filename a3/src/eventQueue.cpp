@@ -0,0 +1,83 @@
+// eventQueue.cpp
+
+
+#include "eventQueue.h"
+
+
+void EventQueue::reserve( int n )
+
+{
+  if (n <= capacity)
+    return;
+
+  Event *newHeap = new Event[ n ];
+
+  for (int i=0; i<numEvents; i++)
+    newHeap[i] = heap[i];
+
+  delete [] heap;
+  heap = newHeap;
+  capacity = n;
+}
+
+
+void EventQueue::grow()
+
+{
+  reserve( capacity > 0 ? 2 * capacity : 64 );
+}
+
+
+
+// Put the event at the end of the heap and move it up past any later
+// parents
+
+void EventQueue::add( const Event &e )
+
+{
+  if (numEvents == capacity)
+    grow();
+
+  int i = numEvents++;
+
+  while (i > 0) {
+    int parent = (i-1) / 2;
+    if (!e.before( heap[parent] ))
+      break;
+    heap[i] = heap[parent];
+    i = parent;
+  }
+
+  heap[i] = e;
+}
+
+
+
+// Take the event at the root, then move the last event down from the
+// root past any earlier children
+
+Event EventQueue::removeFirst()
+
+{
+  Event first = heap[0];
+  Event last  = heap[--numEvents];
+
+  int i = 0;
+
+  while (true) {
+    int child = 2*i + 1;
+    if (child >= numEvents)
+      break;
+    if (child+1 < numEvents && heap[child+1].before( heap[child] ))
+      child++;
+    if (!heap[child].before( last ))
+      break;
+    heap[i] = heap[child];
+    i = child;
+  }
+
+  if (numEvents > 0)
+    heap[i] = last;
+
+  return first;
+}
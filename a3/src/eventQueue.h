@@ -0,0 +1,86 @@
+// eventQueue.h
+//
+// Priority queue of predicted collisions, for the event-driven
+// simulation in World::simulateEvents().
+//
+// An event is a predicted contact between a sphere and another sphere
+// or a rectangle.  It records how many collisions each sphere had had
+// when it was predicted.  If either sphere has collided since, the
+// prediction is out of date and the event is discarded when it comes
+// to the front of the queue, so a collision never has to search the
+// queue for the events that it invalidates.
+//
+// The queue is a binary heap in an array that grows by doubling and is
+// kept between uses, so it stops allocating once it is large enough.
+// Events with equal times come out in order of sphere, then other
+// object, so the simulation is deterministic.
+//
+//   queue.clear();
+//   queue.add( event );
+//
+//   while (!queue.empty()) {
+//     Event e = queue.removeFirst();
+//     ...
+//   }
+
+
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+#include <cstddef>
+
+
+class Event {
+
+ public:
+
+  float time;
+  int   sphere;        // index of the sphere
+  int   other;         // index of the other sphere or rectangle
+  bool  otherIsSphere;
+  int   sphereCount;   // collisions of each sphere when predicted
+  int   otherCount;
+
+  bool before( const Event &e ) const {
+    if (time != e.time)
+      return time < e.time;
+    if (sphere != e.sphere)
+      return sphere < e.sphere;
+    if (otherIsSphere != e.otherIsSphere)
+      return otherIsSphere;
+    return other < e.other;
+  }
+};
+
+
+class EventQueue {
+
+  Event *heap;
+  int    numEvents;
+  int    capacity;
+
+  void grow();
+
+ public:
+
+  EventQueue() {
+    heap = NULL;
+    numEvents = 0;
+    capacity = 0;
+  }
+
+  ~EventQueue() {
+    delete [] heap;
+  }
+
+  void reserve( int n );  // make room for n events
+
+  void clear()   { numEvents = 0; }
+  bool empty()   { return numEvents == 0; }
+  int  size()    { return numEvents; }
+
+  void  add( const Event &e );
+  Event removeFirst();  // earliest event; queue must not be empty
+};
+
+#endif
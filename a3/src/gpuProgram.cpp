@@ -6,6 +6,9 @@
 
 seq<unsigned int> GPUProgram::active_programs; // stack of active programs so that activations can be nested
 
+GLuint GPUProgram::currentProgram = 0;
+GLuint GPUProgram::currentVAO = 0;
+
 
 char* GPUProgram::textFileRead(const char *fileName)
 
@@ -152,23 +155,26 @@ void GPUProgram::init( const char *vsTextIn, const char *fsTextIn, const char* s
 #ifndef MACOS
   GLuint dummy;
   glGenVertexArrays( 1, &dummy );
-  glBindVertexArray( dummy );
+  bindVAO( dummy );
   validateProgram( shaderName );
-  glBindVertexArray( 0 );
+  bindVAO( 0 );
   glDeleteVertexArrays( 1, &dummy );
   //validateProgram( shaderName );
 #else
   // MacOS needs a VAO enabled before it can validate the program ... why?
   GLuint dummy;
   glGenVertexArrays( 1, &dummy );
-  glBindVertexArray( dummy );
+  bindVAO( dummy );
   validateProgram( shaderName );
-  glBindVertexArray( 0 );
+  bindVAO( 0 );
   glDeleteVertexArrays( 1, &dummy );
 #endif
 
-  glUseProgram( program_id );
-  glUseProgram( 0 );
+  findUniforms();
+
+  GLuint previousProgram = currentProgram;
+  useProgram( program_id );
+  useProgram( previousProgram );
   
   glErrorReport( "after GPUProgram::init" );
 
@@ -179,6 +185,67 @@ void GPUProgram::init( const char *vsTextIn, const char *fsTextIn, const char* s
 }
 
 
+// Record the name and location of each active uniform.  Array
+// uniforms are reported as "name[0]" and are recorded as "name".
+
+void GPUProgram::findUniforms()
+
+{
+  for (int i=0; i<numUniforms; i++)
+    free( uniforms[i].name );
+  delete [] uniforms;
+
+  GLint count = 0, maxLength = 0;
+  glGetProgramiv( program_id, GL_ACTIVE_UNIFORMS, &count );
+  glGetProgramiv( program_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength );
+
+  uniforms = new Uniform[ count > 0 ? count : 1 ];
+  numUniforms = 0;
+
+  char *name = new char[ maxLength+1 ];
+
+  for (int i=0; i<count; i++) {
+
+    GLsizei length;
+    GLint   size;
+    GLenum  type;
+
+    glGetActiveUniform( program_id, i, maxLength+1, &length, &size, &type, name );
+
+    if (length > 3 && strcmp( name+length-3, "[0]" ) == 0)
+      name[length-3] = '\0';
+
+    Uniform &u = uniforms[ numUniforms++ ];
+
+    u.name     = strdup( name );
+    u.lastName = NULL;
+    u.location = glGetUniformLocation( program_id, name );
+  }
+
+  delete [] name;
+}
+
+
+// Callers pass the same string literal every time, so the name
+// pointer is checked first; the names are compared only on a miss.
+
+GLint GPUProgram::uniformLocation( const char *name )
+
+{
+  for (int i=0; i<numUniforms; i++)
+    if (uniforms[i].lastName == name)
+      return uniforms[i].location;
+
+  for (int i=0; i<numUniforms; i++)
+    if (strcmp( uniforms[i].name, name ) == 0) {
+      uniforms[i].lastName = name;
+      return uniforms[i].location;
+    }
+
+  return -1;
+}
+
+
 void GPUProgram::initFromFile( const char *vsFile, const char *fsFile, const char* shaderName ) 
 
 {
@@ -1,4 +1,13 @@
 // GPUProgram class
+//
+// Uniform locations are looked up once, when the program is linked,
+// and kept in a small table.  The set*() functions look names up in
+// that table rather than asking GL each time.
+//
+// The currently bound program and VAO are tracked so that binding one
+// that is already bound costs nothing.  All binding of programs and
+// VAOs should go through activate()/deactivate() and bindVAO() so that
+// the tracked state stays correct.
 
 #ifndef GPU_PROGRAM_H
 #define GPU_PROGRAM_H
@@ -17,15 +26,48 @@ class GPUProgram {
 
   static seq<unsigned int> active_programs; // stack of active GPU programs to allow nested activation
 
+  static GLuint currentProgram;  // as last passed to glUseProgram()
+  static GLuint currentVAO;      // as last passed to glBindVertexArray()
+
+  // Active uniforms, found when the program is linked
+
+  class Uniform {
+  public:
+    char       *name;
+    const char *lastName;  // name pointer last used to find this uniform
+    GLint       location;
+  };
+
+  Uniform *uniforms;
+  int      numUniforms;
+
+  void findUniforms();
+
+  static void useProgram( GLuint id ) {
+    if (id != currentProgram) {
+      glUseProgram( id );
+      currentProgram = id;
+    }
+  }
+
  public:
 
-  GPUProgram() {};
+  GPUProgram() { uniforms = NULL; numUniforms = 0; };
 
   GPUProgram( const char *vsFile, const char *fsFile, const char* shaderName ) {
+    uniforms = NULL;
+    numUniforms = 0;
     initFromFile( vsFile, fsFile, shaderName );
   }
 
   ~GPUProgram() {
+    if (currentProgram == program_id)
+      useProgram( 0 );
+
+    for (int i=0; i<numUniforms; i++)
+      free( uniforms[i].name );
+    delete [] uniforms;
+
     glDetachShader( program_id, shader_vp );
     glDeleteShader( shader_vp );
 
@@ -42,50 +84,66 @@ class GPUProgram {
   }
 
   void activate() {
-    glUseProgram( program_id );
+    useProgram( program_id );
     active_programs.add( program_id );
   }
 
+  // If no program was in use before this one, this one is left bound
+  // (but not active) so that activating it again is free.
+
   void deactivate() {
     active_programs.remove();
     if (active_programs.size() > 0)
-      glUseProgram( active_programs[ active_programs.size()-1 ] ); // re-activate the GPU program that was in use before this one
-    else
-      glUseProgram( 0 );
+      useProgram( active_programs[ active_programs.size()-1 ] ); // re-activate the GPU program that was in use before this one
+  }
+
+  // Bind a VAO, unless it is already bound.  A VAO that is to be
+  // deleted should be unbound first with bindVAO(0).
+
+  static void bindVAO( GLuint VAO ) {
+    if (VAO != currentVAO) {
+      glBindVertexArray( VAO );
+      currentVAO = VAO;
+    }
   }
 
+  // Location of a uniform, or -1 if the program has no such uniform
+  // (which glUniform*() ignores, as it did with glGetUniformLocation())
+
+  GLint uniformLocation( const char *name );
+
   char* textFileRead(const char *fileName);
 
   void setMat4( const char *name, mat4 &M ) {
-    glUniformMatrix4fv( glGetUniformLocation( program_id, name ), 1, GL_TRUE, &M[0][0] );
+    glUniformMatrix4fv( uniformLocation( name ), 1, GL_TRUE, &M[0][0] );
   }
 
   void setVec3( const char *name, vec3 v ) {
-    glUniform3fv( glGetUniformLocation( program_id, name ), 1, &v[0] );
+    glUniform3fv( uniformLocation( name ), 1, &v[0] );
   }
 
   void setVec3( const char *name, vec3 *vs, int size ) {
-    glUniform3fv( glGetUniformLocation( program_id, name ), size, &vs[0][0] ); /* indexed array */
+    glUniform3fv( uniformLocation( name ), size, &vs[0][0] ); /* indexed array */
   }
 
   void setVec2( const char *name, vec2 v ) {
-    glUniform2fv( glGetUniformLocation( program_id, name ), 1, &v[0] );
+    glUniform2fv( uniformLocation( name ), 1, &v[0] );
   }
 
   void setVec4( const char *name, vec4 v ) {
-    glUniform4fv( glGetUniformLocation( program_id, name ), 1, &v[0] );
+    glUniform4fv( uniformLocation( name ), 1, &v[0] );
   }
 
   void setVec4( const char *name, vec4 *vs, int size ) {
-    glUniform4fv( glGetUniformLocation( program_id, name ), size, &vs[0][0] ); /* indexed array */
+    glUniform4fv( uniformLocation( name ), size, &vs[0][0] ); /* indexed array */
   }
 
   void setFloat( const char *name, float f ) {
-    glUniform1f( glGetUniformLocation( program_id, name ), f );
+    glUniform1f( uniformLocation( name ), f );
   }
 
   void setInt( const char *name, int i ) {
-    glUniform1i( glGetUniformLocation( program_id, name ), i );
+    glUniform1i( uniformLocation( name ), i );
   }
 
   void glErrorReport( const char *where ) {
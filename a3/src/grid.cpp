@@ -0,0 +1,112 @@
+// grid.cpp
+
+
+#include "grid.h"
+
+
+// Make room for n spheres and their buckets
+
+void SphereGrid::reserve( int n )
+
+{
+  int nBuckets = 1;
+  while (nBuckets < 2*n)
+    nBuckets *= 2;
+
+  if (n > sphereCapacity) {
+    delete [] cellCoords;
+    delete [] bucketOf;
+    delete [] sorted;
+    sphereCapacity = n;
+    cellCoords = new int[ 3*sphereCapacity ];
+    bucketOf   = new int[ sphereCapacity ];
+    sorted     = new int[ sphereCapacity ];
+  }
+
+  if (nBuckets+1 > bucketCapacity) {
+    delete [] bucketStart;
+    bucketCapacity = nBuckets+1;
+    bucketStart = new int[ bucketCapacity ];
+  }
+}
+
+
+// Bin the sphere centres into the grid.  The arrays are kept between
+// calls and only grow, so rebuilding every step does not allocate once
+// the number of spheres has settled.
+
+void SphereGrid::build( const float *x, const float *y, const float *z, int n, float cellSize )
+
+{
+  this->numSpheres = n;
+  this->cellSize   = cellSize;
+
+  // Table size: a power of two at least twice the number of spheres
+
+  numBuckets = 1;
+  while (numBuckets < 2*n)
+    numBuckets *= 2;
+
+  reserve( n );
+
+  // Counting sort of spheres by bucket
+
+  for (int b=0; b<=numBuckets; b++)
+    bucketStart[b] = 0;
+
+  float invCellSize = 1.0 / cellSize;
+
+  for (int i=0; i<n; i++) {
+    int *c = &cellCoords[3*i];
+    c[0] = (int) floor( x[i] * invCellSize );
+    c[1] = (int) floor( y[i] * invCellSize );
+    c[2] = (int) floor( z[i] * invCellSize );
+    bucketOf[i] = bucket( c[0], c[1], c[2] );
+    bucketStart[ bucketOf[i]+1 ]++;
+  }
+
+  for (int b=0; b<numBuckets; b++)
+    bucketStart[b+1] += bucketStart[b];
+
+  // Scatter the spheres, using each bucket start as a cursor, then
+  // shift the starts back into place.
+
+  for (int i=0; i<n; i++)
+    sorted[ bucketStart[ bucketOf[i] ]++ ] = i;
+
+  for (int b=numBuckets; b>0; b--)
+    bucketStart[b] = bucketStart[b-1];
+  bucketStart[0] = 0;
+}
+
+
+// Find the distinct buckets of the 3x3x3 block of cells around sphere
+// i.  'buckets' must have room for 27 entries.
+
+int SphereGrid::neighbourCells( int i, int *buckets )
+
+{
+  int *c = &cellCoords[3*i];
+  int n = 0;
+
+  for (int dx=-1; dx<=1; dx++)
+    for (int dy=-1; dy<=1; dy++)
+      for (int dz=-1; dz<=1; dz++) {
+
+	int b = bucket( c[0]+dx, c[1]+dy, c[2]+dz );
+
+	// Skip buckets already listed (hash collisions between neighbouring cells)
+
+	bool found = false;
+	for (int k=0; k<n; k++)
+	  if (buckets[k] == b) {
+	    found = true;
+	    break;
+	  }
+
+	if (!found)
+	  buckets[n++] = b;
+      }
+
+  return n;
+}
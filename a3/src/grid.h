@@ -0,0 +1,81 @@
+// grid.h
+//
+// Uniform grid (spatial hash) over sphere centres for the
+// sphere/sphere broadphase.
+//
+// Cells are cubes of side 'cellSize'.  If every sphere radius is at
+// most cellSize/2, two spheres can only touch if their centres are in
+// the same or adjacent cells.  Cells are hashed into a table of about
+// twice the number of spheres, so memory is independent of the extent
+// of the world.
+//
+// Use it:
+//
+//    grid.build( x, y, z, n, cellSize );   // sphere centres, as in SphereStateArrays
+//
+//    int cells[27];
+//    int nCells = grid.neighbourCells( i, cells );
+//
+//    for (int c=0; c<nCells; c++)
+//      for (int k=grid.cellStart(cells[c]); k<grid.cellEnd(cells[c]); k++) {
+//        int j = grid.sphereAt(k);
+//        ...
+//      }
+//
+// Hash collisions can put spheres from distant cells into the same
+// bucket, so callers must still do an exact distance test.
+
+
+#ifndef GRID_H
+#define GRID_H
+
+#include "linalg.h"
+
+
+class SphereGrid {
+
+  int   numSpheres;
+  int   numBuckets;     // power of two
+  float cellSize;
+
+  int  *cellCoords;     // 3 per sphere: integer cell coordinates
+  int  *bucketOf;       // bucket of each sphere
+  int  *bucketStart;    // numBuckets+1 entries: start of each bucket in 'sorted'
+  int  *sorted;         // sphere indices sorted by bucket
+
+  int   sphereCapacity;
+  int   bucketCapacity;
+
+  int bucket( int ix, int iy, int iz ) {
+    unsigned int h = ((unsigned int) ix * 73856093u) ^ ((unsigned int) iy * 19349663u) ^ ((unsigned int) iz * 83492791u);
+    return h & (numBuckets-1);
+  }
+
+ public:
+
+  SphereGrid() {
+    numSpheres = 0;
+    numBuckets = 0;
+    sphereCapacity = 0;
+    bucketCapacity = 0;
+    cellCoords = bucketOf = bucketStart = sorted = NULL;
+  }
+
+  ~SphereGrid() {
+    delete [] cellCoords;
+    delete [] bucketOf;
+    delete [] bucketStart;
+    delete [] sorted;
+  }
+
+  void reserve( int n );  // make room for n spheres
+  void build( const float *x, const float *y, const float *z, int n, float cellSize );
+
+  int neighbourCells( int i, int *buckets );  // distinct buckets of the 27 cells around sphere i; returns count
+
+  int cellStart( int b ) { return bucketStart[b]; }
+  int cellEnd( int b )   { return bucketStart[b+1]; }
+  int sphereAt( int k )  { return sorted[k]; }
+};
+
+#endif
@@ -5,7 +5,10 @@
 #define HEADERS_H
 
 #include "glad/include/glad/glad.h"
-#include <GLFW/glfw3.h>
+
+#ifndef HEADLESS
+  #include <GLFW/glfw3.h>	// not needed (or available) in the headless simulation build
+#endif
 
 #ifdef LINUX
   #include <unistd.h>		// includes usleep (to sleep for some time)
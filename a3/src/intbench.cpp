@@ -0,0 +1,162 @@
+// intbench.cpp
+//
+// Integrator benchmark.  Moves spheres ballistically under gravity
+// (no collisions) with each integrator and several step sizes, and
+// reports the error against the analytic trajectory
+//
+//    x(t) = x0 + v0 t + 1/2 g t^2
+//
+// along with the cost.
+//
+// Usage:
+//
+//   ./intbench [-n spheres] [-t seconds]
+//
+//   -n spheres  number of spheres (default 10000)
+//   -t seconds  simulated time of each run (default 1)
+//
+// For each integrator and step size, the output lists the number of
+// steps, the derivative evaluations per step, the wall time per
+// sphere per step, the wall time per simulated second, and the
+// largest position and velocity errors over all spheres at the end.
+
+
+#include "integrator.h"
+#include "sphereState.h"
+#include "simd.h"
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <sys/time.h>
+
+using namespace std;
+
+
+#define DEFAULT_NUM_SPHERES 10000
+#define DEFAULT_SIM_SECONDS 1.0
+
+#define GRAVITY_ACCEL vec3( 0, 0, -9.8 )  // as in world.cpp
+
+const float timeSteps[] = { 0.001, 0.002, 0.005, 0.01, 0.02, 0.05 };
+const int   numTimeSteps = sizeof(timeSteps) / sizeof(timeSteps[0]);
+
+
+static double wallTime()
+
+{
+  struct timeval thisTime;
+  gettimeofday( &thisTime, NULL );
+
+  return thisTime.tv_sec + thisTime.tv_usec / 1000000.0;
+}
+
+
+static float randIn( float min, float max )
+
+{
+  return min + (max - min) * (rand() / (float) RAND_MAX);
+}
+
+
+static void usage( char *progName )
+
+{
+  cerr << "Usage: " << progName << " [-n spheres] [-t seconds]" << endl;
+  exit(1);
+}
+
+
+int main( int argc, char **argv )
+
+{
+  int   n          = DEFAULT_NUM_SPHERES;
+  float simSeconds = DEFAULT_SIM_SECONDS;
+
+  for (int i=1; i<argc; i++)
+    if (strcmp( argv[i], "-n" ) == 0 && i+1 < argc)
+      n = atoi( argv[++i] );
+    else if (strcmp( argv[i], "-t" ) == 0 && i+1 < argc)
+      simSeconds = atof( argv[++i] );
+    else
+      usage( argv[0] );
+
+  // Initial state
+
+  SphereStateArrays y0, y, yEnd;
+
+  y0.resize( n );
+
+  srand( 23546234 );
+
+  for (int i=0; i<n; i++) {
+    y0.setPosition( i, vec3( randIn(-2,2), randIn(-2,2), randIn(0,2) ) );
+    y0.setVelocity( i, vec3( randIn(-1,1), randIn(-1,1), randIn(0,3) ) );
+    y0.radius[i] = 0.1;
+    y0.flags[i] = 0;
+  }
+
+  vec3 g = GRAVITY_ACCEL;
+
+  cout << n << " spheres, " << simSeconds << " s of ballistic flight, simd " << simdLevelName( simdLevel() ) << endl
+       << endl
+       << "integrator      dt      steps  evals  ns/sphere/step  ms/sim-s     max |x error|  max |v error|" << endl;
+
+  for (int type=0; type<NUM_INTEGRATORS; type++) {
+
+    Integrator *integrator = newIntegrator( (IntegratorType) type );
+
+    for (int s=0; s<numTimeSteps; s++) {
+
+      float dt     = timeSteps[s];
+      int   nSteps = (int) (simSeconds / dt + 0.5);
+
+      y.copyKinematics( y0 );
+      yEnd.copyKinematics( y0 );
+
+      double startTime = wallTime();
+
+      for (int k=0; k<nSteps; k++) {
+	integrator->step( y, yEnd, dt, g );
+	y.copyKinematics( yEnd );
+      }
+
+      double wallSeconds = wallTime() - startTime;
+
+      // Compare with the exact trajectory (in double precision)
+
+      double t = nSteps * (double) dt;
+      double maxXError = 0, maxVError = 0;
+
+      for (int i=0; i<n; i++)
+	for (int c=0; c<3; c++) {
+	  double x0 = y0.kinematics(c)[i];
+	  double v0 = y0.kinematics(c+3)[i];
+
+	  double xError = fabs( y.kinematics(c)[i]   - (x0 + v0 * t + 0.5 * g[c] * t * t) );
+	  double vError = fabs( y.kinematics(c+3)[i] - (v0 + g[c] * t) );
+
+	  if (xError > maxXError) maxXError = xError;
+	  if (vError > maxVError) maxVError = vError;
+	}
+
+      cout << left << setw(14) << integratorName( (IntegratorType) type ) << right
+	   << setw(6) << dt
+	   << setw(9) << nSteps
+	   << setw(7) << integrator->numEvaluations()
+	   << fixed << setprecision(2)
+	   << setw(16) << wallSeconds * 1e9 / ((double) n * nSteps)
+	   << setw(10) << wallSeconds * 1e3 / t
+	   << scientific << setprecision(3)
+	   << setw(18) << maxXError
+	   << setw(15) << maxVError
+	   << defaultfloat << setprecision(6) << endl;
+    }
+
+    delete integrator;
+  }
+
+  return 0;
+}
@@ -0,0 +1,140 @@
+// integrator.cpp
+
+
+#include "integrator.h"
+#include "simd.h"
+
+
+// Each integrator works on one component (x, y, or z) at a time:
+// position array x[], velocity array v[], and acceleration a.
+
+
+class ExplicitEuler : public Integrator {
+
+ public:
+
+  IntegratorType type()  { return EXPLICIT_EULER; }
+  int numEvaluations()   { return 1; }
+  float pathAccelFactor() { return 0; }  // straight line at the starting velocity
+
+  void step( const SphereStateArrays &y, SphereStateArrays &yEnd, float deltaT, vec3 accel ) {
+
+    for (int k=0; k<3; k++)
+      eulerStep( y.kinematics(k), y.kinematics(k+3),  // position and velocity
+		 yEnd.kinematics(k), yEnd.kinematics(k+3),
+		 deltaT, deltaT * accel[k], y.n );
+  }
+};
+
+
+class SemiImplicitEuler : public Integrator {
+
+ public:
+
+  IntegratorType type()  { return SEMI_IMPLICIT_EULER; }
+  int numEvaluations()   { return 1; }
+  float pathAccelFactor() { return 2; }  // x + v t + a t^2
+
+  void step( const SphereStateArrays &y, SphereStateArrays &yEnd, float deltaT, vec3 accel ) {
+
+    for (int k=0; k<3; k++) {
+
+      const float *x = y.kinematics(k),    *v = y.kinematics(k+3);
+      float *xEnd    = yEnd.kinematics(k), *vEnd = yEnd.kinematics(k+3);
+
+      float dv = deltaT * accel[k];
+
+      for (int i=0; i<y.n; i++) {
+	vEnd[i] = v[i] + dv;
+	xEnd[i] = x[i] + deltaT * vEnd[i];
+      }
+    }
+  }
+};
+
+
+class VelocityVerlet : public Integrator {
+
+ public:
+
+  IntegratorType type()  { return VELOCITY_VERLET; }
+  int numEvaluations()   { return 1; }  // a at the end of one step is a at the start of the next
+  float pathAccelFactor() { return 1; }
+
+  void step( const SphereStateArrays &y, SphereStateArrays &yEnd, float deltaT, vec3 accel ) {
+
+    vec3 accelEnd = accel;  // acceleration at the new positions (gravity does not depend on them)
+
+    for (int k=0; k<3; k++) {
+
+      const float *x = y.kinematics(k),    *v = y.kinematics(k+3);
+      float *xEnd    = yEnd.kinematics(k), *vEnd = yEnd.kinematics(k+3);
+
+      float a = accel[k], aEnd = accelEnd[k];
+
+      for (int i=0; i<y.n; i++) {
+	xEnd[i] = x[i] + deltaT * v[i] + (0.5f * deltaT * deltaT) * a;
+	vEnd[i] = v[i] + (0.5f * deltaT) * (a + aEnd);
+      }
+    }
+  }
+};
+
+
+class RungeKutta4 : public Integrator {
+
+ public:
+
+  IntegratorType type()  { return RK4; }
+  int numEvaluations()   { return 4; }
+  float pathAccelFactor() { return 1; }
+
+  void step( const SphereStateArrays &y, SphereStateArrays &yEnd, float deltaT, vec3 accel ) {
+
+    for (int k=0; k<3; k++) {
+
+      const float *x = y.kinematics(k),    *v = y.kinematics(k+3);
+      float *xEnd    = yEnd.kinematics(k), *vEnd = yEnd.kinematics(k+3);
+
+      float a = accel[k];
+
+      for (int i=0; i<y.n; i++) {
+
+	// Derivatives (dx/dt, dv/dt) at the four stages
+
+	float k1x = v[i],                       k1v = a;
+	float k2x = v[i] + 0.5f * deltaT * k1v, k2v = a;
+	float k3x = v[i] + 0.5f * deltaT * k2v, k3v = a;
+	float k4x = v[i] + deltaT * k3v,        k4v = a;
+
+	xEnd[i] = x[i] + (deltaT / 6) * (k1x + 2*k2x + 2*k3x + k4x);
+	vEnd[i] = v[i] + (deltaT / 6) * (k1v + 2*k2v + 2*k3v + k4v);
+      }
+    }
+  }
+};
+
+
+
+Integrator *newIntegrator( IntegratorType type )
+
+{
+  switch (type) {
+  case SEMI_IMPLICIT_EULER: return new SemiImplicitEuler();
+  case VELOCITY_VERLET:     return new VelocityVerlet();
+  case RK4:                 return new RungeKutta4();
+  default:                  return new ExplicitEuler();
+  }
+}
+
+
+const char *integratorName( IntegratorType type )
+
+{
+  switch (type) {
+  case SEMI_IMPLICIT_EULER: return "semi-implicit";
+  case VELOCITY_VERLET:     return "verlet";
+  case RK4:                 return "rk4";
+  default:                  return "euler";
+  }
+}
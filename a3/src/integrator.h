@@ -0,0 +1,65 @@
+// integrator.h
+//
+// Integrators that advance the positions and velocities in a
+// SphereStateArrays by one time step.
+//
+// The state derivative is dx/dt = v and dv/dt = a, where 'a' is the
+// acceleration of every sphere (gravity).  The integrators differ in
+// how many times they evaluate the derivative per step and in their
+// accuracy:
+//
+//   EXPLICIT_EULER       x += dt v;  v += dt a                    1st order
+//   SEMI_IMPLICIT_EULER  v += dt a;  x += dt v (the new v)        1st order, symplectic
+//   VELOCITY_VERLET      x += dt v + dt^2/2 a;  v += dt/2 (a + a') 2nd order, symplectic
+//   RK4                  classic 4-stage Runge-Kutta              4th order
+//
+// With constant 'a', Verlet and RK4 follow the exact ballistic
+// trajectory (up to rounding), so larger steps can be taken for the
+// same accuracy.  'intbench' measures this.
+//
+//   Integrator *integrator = newIntegrator( RK4 );
+//   integrator->step( yStart, yEnd, deltaT, accel );
+
+
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include "sphereState.h"
+#include "linalg.h"
+
+
+typedef enum { EXPLICIT_EULER, SEMI_IMPLICIT_EULER, VELOCITY_VERLET, RK4, NUM_INTEGRATORS } IntegratorType;
+
+
+class Integrator {
+
+ public:
+
+  virtual ~Integrator() {}
+
+  virtual IntegratorType type() = 0;
+
+  // Number of derivative evaluations per step
+
+  virtual int numEvaluations() = 0;
+
+  // A step of length t moves each sphere along
+  //
+  //   x(t) = x + v t + 1/2 (pathAccelFactor() a) t^2
+  //
+  // which is the path that the analytic TOI predicts contacts along.
+
+  virtual float pathAccelFactor() = 0;
+
+  // Compute yEnd from y over time deltaT.  yEnd must already have
+  // y.n spheres.
+
+  virtual void step( const SphereStateArrays &y, SphereStateArrays &yEnd, float deltaT, vec3 accel ) = 0;
+};
+
+
+Integrator *newIntegrator( IntegratorType type );
+
+const char *integratorName( IntegratorType type );
+
+#endif
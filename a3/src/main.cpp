@@ -83,8 +83,14 @@ void display()
 
   // Output status message
 
+  const char *methodName = (world->collisionTime == EVENT_DRIVEN ? "events" : integratorName( world->integratorType() ));
+
   char buffer[1000];
-  sprintf( buffer, "x %4.2f", timeFactor );
+  if (world->overBudgetFrames > 0)
+    sprintf( buffer, "%s%s%s%s%s  x %4.2f  max %d steps  over budget %ld", methodName, (world->adaptiveTimeStep ? " adaptive" : ""), (world->localRewind ? " local" : ""), (world->batchContacts ? " batch" : ""), (world->sweptCollisions ? " swept" : ""),
+	     timeFactor, world->maxStepsPerFrame, world->overBudgetFrames );
+  else
+    sprintf( buffer, "%s%s%s%s%s  x %4.2f", methodName, (world->adaptiveTimeStep ? " adaptive" : ""), (world->localRewind ? " local" : ""), (world->batchContacts ? " batch" : ""), (world->sweptCollisions ? " swept" : ""), timeFactor );
   strokeFont->drawStrokeString( buffer, 0.95, -0.95, 0.04, 0, RIGHT );
 }
 
@@ -173,13 +179,45 @@ void keyCallback( GLFWwindow* window, int key, int scancode, int action, int mod
       showAxes = !showAxes;
       break;
 
+    case 'B':
+      world->batchContacts = !world->batchContacts;
+      break;
+
     case 'C':
       showClosest = !showClosest;
       break;
 
+    case 'E':
+      world->collisionTime = (world->collisionTime == EVENT_DRIVEN ? BISECTION : EVENT_DRIVEN);
+      break;
+
+    case 'I':
+      world->setIntegrator( (IntegratorType) ((world->integratorType() + 1) % NUM_INTEGRATORS) );
+      break;
+
+    case 'L':
+      world->localRewind = !world->localRewind;
+      break;
+
+    case 'N':
+      world->selectNextSphere();
+      break;
+
     case 'P':
       toggleSleep();
       break;
+
+    case 'S':
+      world->sweptCollisions = !world->sweptCollisions;
+      break;
+
+    case 'T':
+      world->adaptiveTimeStep = !world->adaptiveTimeStep;
+      break;
+
+    case 'X':
+      world->removeSphere( world->selectedSphere );
+      break;
       
     case '+':
     case '=':
@@ -190,6 +228,15 @@ void keyCallback( GLFWwindow* window, int key, int scancode, int action, int mod
     case '_':
       timeFactor /= sqrt(2);
       break;
+
+    case ']':
+      world->maxStepsPerFrame *= 2;
+      break;
+
+    case '[':
+      if (world->maxStepsPerFrame > 1)
+	world->maxStepsPerFrame /= 2;
+      break;
       
     case ' ':
       if (mode == ROTATE)
@@ -39,8 +39,6 @@ public:
     state.w = w;
   }
 
-  virtual void draw( mat4 &WCS_to_VCS, mat4 &VCS_to_CCS, vec3 &lightDir, vec3 &colour ) = 0;
-
   virtual float mass() = 0;
 
   mat4 OCS_to_WCS() {
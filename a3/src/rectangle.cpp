@@ -3,13 +3,42 @@
 #include "rectangle.h"
 
 
+// Compute the transform between the rectangle's coordinate system and
+// the WCS from the rectangle's current state.  The axes are the
+// columns of OCS_to_WCS().
+
+void Rectangle::updateFrame()
+
+{
+  mat4 M = OCS_to_WCS();
+
+  cachedFrame.origin = state.x;
+  cachedFrame.xAxis  = vec3( M[0][0], M[1][0], M[2][0] );
+  cachedFrame.yAxis  = vec3( M[0][1], M[1][1], M[2][1] );
+  cachedFrame.zAxis  = vec3( M[0][2], M[1][2], M[2][2] );
+  cachedFrame.halfX  = xDim / 2.0;
+  cachedFrame.halfY  = yDim / 2.0;
+
+  frameState = state;
+  frameXDim  = xDim;
+  frameYDim  = yDim;
+}
+
+
+#ifndef HEADLESS
+
+
+GLuint      Rectangle::VAO = 0;
+GPUProgram *Rectangle::gpu = NULL;
+
+
 void Rectangle::setupVAO()
 
 {
   // Create a VAO
 
   glGenVertexArrays( 1, &VAO );
-  glBindVertexArray( VAO );
+  GPUProgram::bindVAO( VAO );
 
   // store vertices
 
@@ -36,13 +65,19 @@ void Rectangle::setupVAO()
   // Done
   
   glBindBuffer( GL_ARRAY_BUFFER, 0 );
-  glBindVertexArray( 0 );
+  GPUProgram::bindVAO( 0 );
 }
 
 
 void Rectangle::draw( mat4 &WCS_to_VCS, mat4 &VCS_to_CCS, vec3 &lightDir, vec3 &colour )
 
 {
+  if (gpu == NULL) {
+    gpu = new GPUProgram();
+    gpu->init( vertShader, fragShader, "in rectangle.cpp" );
+    setupVAO();
+  }
+
   mat4 MV  = WCS_to_VCS * OCS_to_WCS() * scale( xDim, yDim, 1 );
   mat4 MVP = VCS_to_CCS * MV;
 
@@ -53,9 +88,8 @@ void Rectangle::draw( mat4 &WCS_to_VCS, mat4 &VCS_to_CCS, vec3 &lightDir, vec3 &
   gpu->setVec3( "colour", colour );
   gpu->setVec3( "lightDir", lightDir );
   
-  glBindVertexArray( VAO );
+  GPUProgram::bindVAO( VAO );
   glDrawArrays( GL_TRIANGLE_FAN, 0, 4 );
-  glBindVertexArray( 0 );
 
   gpu->deactivate();
 }
@@ -121,3 +155,16 @@ const char *Rectangle::fragShader = R"XX(
     outputColour = vec4( NdotL * colour, 1.0 );
   }
 )XX";
+
+
+#else
+
+
+// Headless build: there is nothing to draw into
+
+void Rectangle::draw( mat4 &WCS_to_VCS, mat4 &VCS_to_CCS, vec3 &lightDir, vec3 &colour )
+
+{}
+
+
+#endif
@@ -18,6 +18,34 @@ typedef struct {
 } RectangleDef;
 
 
+// The rigid transform between a rectangle's coordinate system and the
+// WCS, kept as the local axes in the WCS.  Since OCS_to_WCS() is a
+// rotation and a translation, its inverse is just the transposed
+// rotation, so moving a point into the rectangle's coordinate system
+// takes three dot products instead of a mat4 inverse.
+//
+// In its own coordinate system, the rectangle is [-halfX,+halfX] x
+// [-halfY,+halfY] x [0], centred at the origin with normal (0,0,1).
+
+class RectangleFrame {
+
+ public:
+
+  vec3  origin;               // rectangle centre
+  vec3  xAxis, yAxis, zAxis;  // local axes in the WCS; zAxis is the normal
+  float halfX, halfY;
+
+  vec3 toLocal( vec3 p ) const {
+    vec3 d = p - origin;
+    return vec3( d * xAxis, d * yAxis, d * zAxis );
+  }
+
+  vec3 toWorld( vec3 p ) const {
+    return origin + p.x * xAxis + p.y * yAxis + p.z * zAxis;
+  }
+};
+
+
 class Rectangle : public Object {
 
  public:
@@ -50,17 +78,11 @@ class Rectangle : public Object {
       
       this->state.q = quaternion( angle, axis );
 
-      // Set up shaders
-
-      gpu = new GPUProgram();
-      gpu->init( vertShader, fragShader, "in rectangle.cpp" );
-
-      setupVAO();
+      updateFrame();
     };
 
-  Rectangle() {}
+  Rectangle() { frameXDim = -1; }  // (frame is computed on first use)
 
-  ~Rectangle() {}
 
   void draw( mat4 &WCS_to_VCS, mat4 &VCS_to_CCS, vec3 &lightDir, vec3 &colour );
 
@@ -68,11 +90,29 @@ class Rectangle : public Object {
     return 99999; // hack for an immovable object
   }
 
+  // The cached transform to and from the rectangle's coordinate
+  // system.  It is recomputed only if the rectangle has moved or
+  // changed size since it was last computed.
+
+  const RectangleFrame & frame() {
+    if (state.x != frameState.x || state.q != frameState.q || xDim != frameXDim || yDim != frameYDim)
+      updateFrame();
+    return cachedFrame;
+  }
+
  private:
 
-  GLuint          VAO;
+  RectangleFrame cachedFrame;
+  State          frameState;  // state, xDim and yDim from which 'cachedFrame' was computed
+  float          frameXDim, frameYDim;
+
+  void updateFrame();
+
+  // All rectangles are drawn as a scaled unit square, so they share
+  // one VAO and one GPU program.  These are set up on the first draw().
 
-  GPUProgram      *gpu;
+  static GLuint     VAO;
+  static GPUProgram *gpu;
 
   static const vec3 verts[4];
   static const vec3 norms[4];
@@ -10,13 +10,25 @@
  *
  *     seq()               Create an empty sequence
  *
+ *   Sequences can be moved, which takes the other sequence's storage
+ *   rather than copying it.  Elements are moved, not copied, when the
+ *   storage grows and when elements are shifted.
+ *
  *   PUBLIC FUNCTIONS
  *
- *     add( x )            Add x to the end of the sequence
+ *     add( x )            Add x to the end of the sequence (moved in if x is an rvalue)
+ *     emplace( args )     Move-assign a temporary T(args) to the end of the sequence
+ *                         and return it.  (The storage holds default-constructed
+ *                         elements, so nothing is constructed in place.)
+ *     reserve( n )        Make room for n elements without growing
  *     remove()            Remove the last element of the sequence
  *     remove( i )         Remove the i^{th} element of the sequence (expensive)
+ *     swap_remove( i )    Remove the i^{th} element, moving the last element into its place
  *     shift( i )          Shift right everything starting at position i
- *     operator [i]        Returns the i^{th} element (starting from 0)
+ *     operator [i]        Returns the i^{th} element (starting from 0).  The index is
+ *                         checked with assert(), so not when NDEBUG is defined.
+ *     unchecked( i )      Returns the i^{th} element, never checked (for hot loops)
+ *     begin(), end()      Pointers to the first and one-past-the-last elements
  *     exists( x )         Return true if x exists in sequence, false otherwise
  *     clear()             Deletes the whole sequence
  *     findIndex( x )      Find the index of element x, or -1 if it doesn't exist
@@ -30,6 +42,8 @@
 
 #include <iostream>
 #include <stdlib.h>
+#include <cassert>
+#include <utility>
 
 using namespace std;
 
@@ -40,6 +54,8 @@ template<class T> class seq {
   int numElements;
   T  *data;
 
+  void grow( int newStorageSize );
+
 public:
 
   seq() {			// constructor
@@ -75,6 +91,17 @@ public:
       data[i] = source.data[i];
   }
 
+  seq( seq<T> && source ) {	// move constructor
+
+    storageSize = source.storageSize;
+    numElements = source.numElements;
+    data = source.data;
+
+    source.storageSize = 0;
+    source.numElements = 0;
+    source.data = NULL;
+  }
+
   void remove() {
     if (numElements == 0) {
       cerr << "remove: Tried to remove element from empty sequence\n";
@@ -93,18 +120,27 @@ public:
   }
 
   T & operator [] ( int i ) const {
-    if (i >= numElements || i < 0) {
-      cerr << "element: Tried to access an element beyond the range of the sequence: "
-	   << i << "(numElements = " << numElements << ")\n";
-      { int i = 0;
-      int j = 1 / i;
-      j = j;
-      }
-      exit(-1);
-    }
+    assert( i >= 0 && i < numElements );
     return data[ i ];
   }
 
+  T & unchecked( int i ) const {
+    return data[ i ];
+  }
+
+  T *begin() const {
+    return data;
+  }
+
+  T *end() const {
+    return data + numElements;
+  }
+
+  void reserve( int n ) {
+    if (n > storageSize)
+      grow( n );
+  }
+
   void clear() {
     delete [] data;
     storageSize = 1;
@@ -113,6 +149,8 @@ public:
   }
 
   seq<T> & operator = (const seq<T> &source) { // assignment operator
+    if (this == &source)
+      return *this;
     storageSize = source.storageSize;
     numElements = source.numElements;
     delete [] data;
@@ -122,12 +160,55 @@ public:
     return *this;
   }
 
+  seq<T> & operator = (seq<T> &&source) { // move assignment operator
+    if (this == &source)
+      return *this;
+    delete [] data;
+    storageSize = source.storageSize;
+    numElements = source.numElements;
+    data = source.data;
+    source.storageSize = 0;
+    source.numElements = 0;
+    source.data = NULL;
+    return *this;
+  }
+
   void add( const T &x );
+  void add( T &&x );
+  void swap_remove( int i );
+
+  // Builds a temporary T and move-assigns it into the next element
+
+  template<class... Args> T & emplace( Args&&... args ) {
+    if (numElements == storageSize)
+      grow( storageSize > 0 ? storageSize * 2 : 2 );
+    data[ numElements ] = T( std::forward<Args>(args)... );
+    return data[ numElements++ ];
+  }
+
   int findIndex( const T &x );
   bool exists( const T &x );
 };
 
 
+// Move the elements to new storage of the given size
+
+template<class T>
+void 
+seq<T>::grow( int newStorageSize )
+
+{
+  T *newData;
+
+  newData = new T[ newStorageSize ];
+  for (int i=0; i<numElements; i++)
+    newData[i] = std::move( data[i] );
+  storageSize = newStorageSize;
+  delete [] data;
+  data = newData;
+}
+
+
 // Add an element to the end of the sequence
 
 template<class T>
@@ -135,17 +216,15 @@ void
 seq<T>::add( const T &x )
 
 {
-  // No storage left?  If so, double the storage
+  // No storage left?  If so, double the storage.  (x is copied first
+  // in case it is an element of this sequence.)
 
   if (numElements == storageSize) {
-    T *newData;
-
-    newData = new T[ storageSize * 2 ];
-    for (int i=0; i<storageSize; i++)
-      newData[i] = data[i];
-    storageSize = storageSize * 2;
-    delete [] data;
-    data = newData;
+    T copy = x;
+    grow( storageSize > 0 ? storageSize * 2 : 2 );
+    data[ numElements ] = std::move( copy );
+    numElements++;
+    return;
   }
 
   // Store the element in the next available position
@@ -155,6 +234,19 @@ seq<T>::add( const T &x )
 }
 
 
+template<class T>
+void 
+seq<T>::add( T &&x )
+
+{
+  if (numElements == storageSize)
+    grow( storageSize > 0 ? storageSize * 2 : 2 );
+
+  data[ numElements ] = std::move( x );
+  numElements++;
+}
+
+
 // Compress the array
 
 template<class T>
@@ -219,19 +311,11 @@ seq<T>::shift( int i )
     exit(-1);
   }
 
-  if (numElements == storageSize) {
-    T *newData;
-
-    newData = new T[ storageSize * 2 ];
-    for (int i=0; i<storageSize; i++)
-      newData[i] = data[i];
-    storageSize = storageSize * 2;
-    delete [] data;
-    data = newData;
-  }
+  if (numElements == storageSize)
+    grow( storageSize > 0 ? storageSize * 2 : 2 );
 
   for (int j=numElements; j>i; j--)
-    data[j] = data[j-1];
+    data[j] = std::move( data[j-1] );
 
   numElements++;
 }
@@ -247,14 +331,32 @@ seq<T>::remove( int i )
   if (i < 0 || i >= numElements) {
     cerr << "remove: Tried to remove element " << i
 	 << " from a sequence of " << numElements << " elements \n";
-    { int i = 0;
-    int j = 1 / i;
-    }
     exit(-1);
   }
 
   for (int j=i; j<numElements-1; j++)
-    data[j] = data[j+1];
+    data[j] = std::move( data[j+1] );
+
+  numElements--;
+}
+
+
+// Remove an element in O(1) by moving the last element into its
+// place.  This changes the order of the elements.
+
+template<class T>
+void 
+seq<T>::swap_remove( int i )
+
+{
+  if (i < 0 || i >= numElements) {
+    cerr << "swap_remove: Tried to remove element " << i
+	 << " from a sequence of " << numElements << " elements \n";
+    exit(-1);
+  }
+
+  if (i != numElements-1)
+    data[i] = std::move( data[numElements-1] );
 
   numElements--;
 }
@@ -0,0 +1,290 @@
+// simd.cpp
+
+
+#include "simd.h"
+
+#include <cmath>
+
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+  #define SIMD_X86
+  #include <immintrin.h>
+  #ifdef _MSC_VER
+    #include <intrin.h>
+    #define TARGET_SSE
+    #define TARGET_AVX2
+  #else
+    #define TARGET_SSE  __attribute__((target("sse2")))
+    #define TARGET_AVX2 __attribute__((target("avx2")))
+  #endif
+#endif
+
+
+static SimdLevel currentLevel = simdSupported();  // chosen before main(), so threads see a fixed value
+
+
+
+// CPU feature detection
+
+SimdLevel simdSupported()
+
+{
+#ifndef SIMD_X86
+
+  return SIMD_SCALAR;
+
+#elif defined(_MSC_VER)
+
+  int info[4];
+
+  __cpuid( info, 1 );
+
+  bool sse2    = (info[3] & (1<<26)) != 0;
+  bool osxsave = (info[2] & (1<<27)) != 0;
+  bool avx     = (info[2] & (1<<28)) != 0;
+
+  bool avx2 = false;
+  if (osxsave && avx && (_xgetbv(0) & 6) == 6) { // OS saves the AVX registers
+    __cpuidex( info, 7, 0 );
+    avx2 = (info[1] & (1<<5)) != 0;
+  }
+
+  return (avx2 ? SIMD_AVX2 : sse2 ? SIMD_SSE : SIMD_SCALAR);
+
+#else
+
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports( "avx2" ))
+    return SIMD_AVX2;
+  if (__builtin_cpu_supports( "sse2" ))
+    return SIMD_SSE;
+  return SIMD_SCALAR;
+
+#endif
+}
+
+
+SimdLevel simdLevel()
+
+{
+  return currentLevel;
+}
+
+
+void setSimdLevel( SimdLevel level )
+
+{
+  SimdLevel supported = simdSupported();
+
+  currentLevel = (level > supported ? supported : level);
+}
+
+
+const char *simdLevelName( SimdLevel level )
+
+{
+  switch (level) {
+  case SIMD_AVX2: return "avx2";
+  case SIMD_SSE:  return "sse";
+  default:        return "scalar";
+  }
+}
+
+
+
+// ---------------- Euler step ----------------
+
+
+static void eulerStepScalar( const float *x, const float *v, float *xEnd, float *vEnd, float deltaT, float dv, int start, int n )
+
+{
+  for (int i=start; i<n; i++) {
+    xEnd[i] = x[i] + deltaT * v[i];
+    vEnd[i] = v[i] + dv;
+  }
+}
+
+
+#ifdef SIMD_X86
+
+TARGET_SSE
+static int eulerStepSSE( const float *x, const float *v, float *xEnd, float *vEnd, float deltaT, float dv, int n )
+
+{
+  __m128 dt4 = _mm_set1_ps( deltaT );
+  __m128 dv4 = _mm_set1_ps( dv );
+
+  int i;
+  for (i=0; i+4<=n; i+=4) {
+    __m128 vi = _mm_loadu_ps( v+i );
+    _mm_storeu_ps( xEnd+i, _mm_add_ps( _mm_loadu_ps( x+i ), _mm_mul_ps( dt4, vi ) ) );
+    _mm_storeu_ps( vEnd+i, _mm_add_ps( vi, dv4 ) );
+  }
+
+  return i;
+}
+
+
+TARGET_AVX2
+static int eulerStepAVX2( const float *x, const float *v, float *xEnd, float *vEnd, float deltaT, float dv, int n )
+
+{
+  __m256 dt8 = _mm256_set1_ps( deltaT );
+  __m256 dv8 = _mm256_set1_ps( dv );
+
+  int i;
+  for (i=0; i+8<=n; i+=8) {
+    __m256 vi = _mm256_loadu_ps( v+i );
+    _mm256_storeu_ps( xEnd+i, _mm256_add_ps( _mm256_loadu_ps( x+i ), _mm256_mul_ps( dt8, vi ) ) );
+    _mm256_storeu_ps( vEnd+i, _mm256_add_ps( vi, dv8 ) );
+  }
+
+  return i;
+}
+
+#endif
+
+
+void eulerStep( const float *x, const float *v, float *xEnd, float *vEnd, float deltaT, float dv, int n )
+
+{
+  int done = 0;  // number handled by the vector code; the scalar code does the rest
+
+#ifdef SIMD_X86
+  switch (simdLevel()) {
+  case SIMD_AVX2: done = eulerStepAVX2( x, v, xEnd, vEnd, deltaT, dv, n ); break;
+  case SIMD_SSE:  done = eulerStepSSE( x, v, xEnd, vEnd, deltaT, dv, n );  break;
+  default:        break;
+  }
+#endif
+
+  eulerStepScalar( x, v, xEnd, vEnd, deltaT, dv, done, n );
+}
+
+
+
+// ---------------- Sphere/sphere approach distances ----------------
+
+
+static void approachDistancesScalar( const SphereStateArrays &s, int i, const int *js, int start, int count, float *dist )
+
+{
+  float xi = s.x[i],  yi = s.y[i],  zi = s.z[i];
+  float vxi = s.vx[i], vyi = s.vy[i], vzi = s.vz[i];
+  float ri = s.radius[i];
+
+  for (int k=start; k<count; k++) {
+
+    int j = js[k];
+
+    float dx = s.x[j] - xi;
+    float dy = s.y[j] - yi;
+    float dz = s.z[j] - zi;
+
+    float sign = (s.vx[j] - vxi) * dx + (s.vy[j] - vyi) * dy + (s.vz[j] - vzi) * dz;
+
+    if (sign < 0)
+      dist[k] = (sqrtf( dx*dx + dy*dy + dz*dz ) - ri) - s.radius[j];
+    else
+      dist[k] = NOT_APPROACHING;
+  }
+}
+
+
+#ifdef SIMD_X86
+
+// The SSE version loads each sphere j's values separately, as SSE
+// has no gather.
+
+TARGET_SSE
+static int approachDistancesSSE( const SphereStateArrays &s, int i, const int *js, int count, float *dist )
+
+{
+  __m128 xi  = _mm_set1_ps( s.x[i] ),  yi  = _mm_set1_ps( s.y[i] ),  zi  = _mm_set1_ps( s.z[i] );
+  __m128 vxi = _mm_set1_ps( s.vx[i] ), vyi = _mm_set1_ps( s.vy[i] ), vzi = _mm_set1_ps( s.vz[i] );
+  __m128 ri  = _mm_set1_ps( s.radius[i] );
+
+  __m128 zero = _mm_setzero_ps();
+  __m128 none = _mm_set1_ps( NOT_APPROACHING );
+
+#define GATHER4(a) _mm_set_ps( a[js[k+3]], a[js[k+2]], a[js[k+1]], a[js[k]] )
+
+  int k;
+  for (k=0; k+4<=count; k+=4) {
+
+    __m128 dx = _mm_sub_ps( GATHER4(s.x), xi );
+    __m128 dy = _mm_sub_ps( GATHER4(s.y), yi );
+    __m128 dz = _mm_sub_ps( GATHER4(s.z), zi );
+
+    __m128 sign = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_sub_ps( GATHER4(s.vx), vxi ), dx ),
+					  _mm_mul_ps( _mm_sub_ps( GATHER4(s.vy), vyi ), dy ) ),
+			      _mm_mul_ps( _mm_sub_ps( GATHER4(s.vz), vzi ), dz ) );
+
+    __m128 dist2 = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx, dx ), _mm_mul_ps( dy, dy ) ), _mm_mul_ps( dz, dz ) );
+    __m128 d     = _mm_sub_ps( _mm_sub_ps( _mm_sqrt_ps( dist2 ), ri ), GATHER4(s.radius) );
+
+    __m128 approaching = _mm_cmplt_ps( sign, zero );
+
+    _mm_storeu_ps( dist+k, _mm_or_ps( _mm_and_ps( approaching, d ), _mm_andnot_ps( approaching, none ) ) );
+  }
+
+#undef GATHER4
+
+  return k;
+}
+
+
+TARGET_AVX2
+static int approachDistancesAVX2( const SphereStateArrays &s, int i, const int *js, int count, float *dist )
+
+{
+  __m256 xi  = _mm256_set1_ps( s.x[i] ),  yi  = _mm256_set1_ps( s.y[i] ),  zi  = _mm256_set1_ps( s.z[i] );
+  __m256 vxi = _mm256_set1_ps( s.vx[i] ), vyi = _mm256_set1_ps( s.vy[i] ), vzi = _mm256_set1_ps( s.vz[i] );
+  __m256 ri  = _mm256_set1_ps( s.radius[i] );
+
+  __m256 zero = _mm256_setzero_ps();
+  __m256 none = _mm256_set1_ps( NOT_APPROACHING );
+
+  int k;
+  for (k=0; k+8<=count; k+=8) {
+
+    __m256i j = _mm256_loadu_si256( (const __m256i *) (js+k) );
+
+    __m256 dx = _mm256_sub_ps( _mm256_i32gather_ps( s.x, j, 4 ), xi );
+    __m256 dy = _mm256_sub_ps( _mm256_i32gather_ps( s.y, j, 4 ), yi );
+    __m256 dz = _mm256_sub_ps( _mm256_i32gather_ps( s.z, j, 4 ), zi );
+
+    __m256 sign = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( _mm256_sub_ps( _mm256_i32gather_ps( s.vx, j, 4 ), vxi ), dx ),
+						_mm256_mul_ps( _mm256_sub_ps( _mm256_i32gather_ps( s.vy, j, 4 ), vyi ), dy ) ),
+				 _mm256_mul_ps( _mm256_sub_ps( _mm256_i32gather_ps( s.vz, j, 4 ), vzi ), dz ) );
+
+    __m256 dist2 = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( dx, dx ), _mm256_mul_ps( dy, dy ) ), _mm256_mul_ps( dz, dz ) );
+    __m256 d     = _mm256_sub_ps( _mm256_sub_ps( _mm256_sqrt_ps( dist2 ), ri ), _mm256_i32gather_ps( s.radius, j, 4 ) );
+
+    __m256 approaching = _mm256_cmp_ps( sign, zero, _CMP_LT_OQ );
+
+    _mm256_storeu_ps( dist+k, _mm256_blendv_ps( none, d, approaching ) );
+  }
+
+  return k;
+}
+
+#endif
+
+
+void approachDistances( const SphereStateArrays &s, int i, const int *js, int count, float *dist )
+
+{
+  int done = 0;
+
+#ifdef SIMD_X86
+  switch (simdLevel()) {
+  case SIMD_AVX2: done = approachDistancesAVX2( s, i, js, count, dist ); break;
+  case SIMD_SSE:  done = approachDistancesSSE( s, i, js, count, dist );  break;
+  default:        break;
+  }
+#endif
+
+  approachDistancesScalar( s, i, js, done, count, dist );
+}
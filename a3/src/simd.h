@@ -0,0 +1,52 @@
+// simd.h
+//
+// Vectorized kernels for the physics loops, over the arrays of a
+// SphereStateArrays.
+//
+// Each kernel has a scalar version, a 4-wide SSE version and an 8-wide
+// AVX2 version.  The version is chosen at run time from the CPU
+// features, or can be forced with setSimdLevel().  Only the AVX2
+// functions are compiled for AVX2, so the program still runs on CPUs
+// without it.
+//
+// All versions do the same float operations in the same order (no
+// fused multiply-add), so they give bit-identical results.
+
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include "sphereState.h"
+#include <cfloat>
+
+
+typedef enum { SIMD_SCALAR, SIMD_SSE, SIMD_AVX2 } SimdLevel;
+
+#define NOT_APPROACHING FLT_MAX  // approachDistances() result for spheres that are not coming together
+
+
+SimdLevel simdSupported();             // best level this CPU supports
+SimdLevel simdLevel();                 // level in use (simdSupported() unless set)
+void      setSimdLevel( SimdLevel level );  // clamped to simdSupported()
+
+const char *simdLevelName( SimdLevel level );
+
+
+// Explicit Euler step of one component:
+//
+//   xEnd[i] = x[i] + deltaT * v[i]
+//   vEnd[i] = v[i] + dv
+
+void eulerStep( const float *x, const float *v, float *xEnd, float *vEnd, float deltaT, float dv, int n );
+
+
+// For sphere i and each sphere j = js[k], k < count, set dist[k] to
+// the distance between their surfaces if they are coming together,
+// or to NOT_APPROACHING if not.  The distance is computed as in
+// findCollisions():
+//
+//   (|x_j - x_i| - r_i) - r_j    if (v_j - v_i) . (x_j - x_i) < 0
+
+void approachDistances( const SphereStateArrays &s, int i, const int *js, int count, float *dist );
+
+#endif
@@ -0,0 +1,409 @@
+// simrun.cpp
+//
+// Headless simulation driver.  Loads a scene file, runs the world for
+// a given number of simulated seconds as fast as possible (without
+// GLFW or OpenGL), and reports the throughput.
+//
+// Usage:
+//
+//   ./simrun [-t seconds] [-brute] [-toi] [-events] [-local] [-batch] [-swept] [-simd level] [-threads n] [-nosleep] [-nozeno] [-noseparate] [-maxsteps n]
+//            [-integrator name] [-dt seconds] [-adaptive [min max]] [-noalloc] [-energy] [-handles] [-o outFile] [sceneFile]
+//
+//   -t seconds  simulated time to run (default 10)
+//   -brute      use the O(n^2) sphere/sphere reference broadphase
+//   -toi        find collision times analytically instead of by binary search
+//   -events     jump from collision to collision (event-driven) instead of stepping
+//   -local      on a collision, rewind only the spheres that could be involved in it
+//   -batch      on a collision, resolve all contacts found with it together
+//   -swept      find contacts along the spheres' paths, so fast spheres do not pass through objects
+//   -simd level use the 'scalar', 'sse' or 'avx2' kernels (default: best the CPU supports)
+//   -threads n  use n threads for collision detection and -local islands (default: one per core)
+//   -nosleep    do not put resting spheres to sleep
+//   -nozeno     do not cut short the bounces of a sphere coming to rest on a rectangle
+//   -noseparate do not give resting contacts the separating speed that keeps the
+//               semi-implicit, verlet and rk4 integrators from stalling on them (so
+//               that no collision adds energy, but those integrators can stall)
+//   -maxsteps n take at most n time steps per frame (frames over budget drop time)
+//   -integrator name
+//               integrate with 'euler' (default), 'semi-implicit', 'verlet' or 'rk4'
+//   -dt seconds time step (default 0.001)
+//   -adaptive [min max]
+//               choose each time step from the gaps between objects, within
+//               [min,max] seconds (default [0.0005,0.02])
+//   -noalloc    fail (exit status 2) if any heap allocation is made after the first frame
+//   -energy     fail (exit status 3) if the spheres' total energy rises from one frame to the
+//               next (explicit Euler steps gain energy in free flight, so use another integrator)
+//   -handles    fail (exit status 4) if the sphere handles taken at the start do not follow
+//               their spheres through the run and a removal (see checkHandles())
+//   -o outFile  write the final spheres to outFile, in scene-file format
+//
+// With no scene file, the spheres are generated randomly as in the
+// interactive program.
+//
+// Heap allocations are counted by replacing the global operator new.
+// The first frame sizes the World's scratch buffers, after which
+// stepping should not allocate.  (Adding a sphere's third rolling
+// constraint still does.)
+//
+// tests/bounce.txt drops spheres onto the floor and onto each other.
+// None of its collisions should add energy:
+//
+//   ./simrun -t 5 -energy -integrator verlet ../tests/bounce.txt
+//
+// In tests/fall.txt, some spheres fall out of the pit and are removed,
+// so the remaining ones are moved to new indices:
+//
+//   ./simrun -t 5 -handles ../tests/fall.txt
+
+
+#include "headers.h"
+#include "world.h"
+#include "main.h"
+#include "simd.h"
+
+#include <new>
+#include <cctype>
+#include <atomic>
+
+
+#define DEFAULT_SIM_SECONDS  10.0
+#define FRAME_TIME           (1/60.0)  // simulated time passed to updateState() per call
+#define ENERGY_TOLERANCE     1e-6      // fraction of the starting energy that -energy lets it rise by in a frame (rounding)
+
+
+float timeFactor = 1;  // run at simulated time == elapsed time
+
+
+// Allocation counter (atomic, as islands are simulated on worker
+// threads)
+
+static std::atomic<long> numAllocations( 0 );
+
+void *operator new( size_t size )
+
+{
+  numAllocations++;
+
+  void *p = malloc( size > 0 ? size : 1 );
+  if (p == NULL)
+    throw std::bad_alloc();
+
+  return p;
+}
+
+void *operator new[]( size_t size ) { return operator new( size ); }
+
+void operator delete( void *p ) noexcept   { free( p ); }
+void operator delete[]( void *p ) noexcept { free( p ); }
+
+
+// Wall-clock time in seconds
+
+static double wallTime()
+
+{
+  struct timeval thisTime;
+  gettimeofday( &thisTime, NULL );
+
+  return thisTime.tv_sec + thisTime.tv_usec / 1000000.0;
+}
+
+
+static bool isNumber( char *arg )
+
+{
+  return isdigit( arg[0] ) || arg[0] == '.';
+}
+
+
+// Check that sphere handles follow their spheres.  'handles' were
+// taken for all the spheres at the start of the run, during which
+// some may have fallen out of the pit and been removed.  Each
+// remaining sphere must be named by exactly one of the handles, and
+// the others must name no sphere.  Then removing the first sphere
+// moves the last one into its place: the last one's handle must
+// still name it, and the first one's handle must name no sphere.
+// This removes up to two spheres from the world.
+
+static bool checkHandles( World *world, seq<SphereHandle> &handles )
+
+{
+  int numNamed = 0;
+
+  for (int k=0; k<handles.size(); k++) {
+    Sphere *s = world->sphere( handles[k] );
+    if (s == NULL)
+      continue;
+    for (int l=0; l<k; l++)
+      if (world->sphere( handles[l] ) == s)
+	return false;
+    numNamed++;
+  }
+
+  if (numNamed != world->numSpheres())
+    return false;
+
+  if (world->numSpheres() < 2)
+    return true;
+
+  SphereHandle first = world->sphereHandle( 0 );
+  SphereHandle last  = world->sphereHandle( world->numSpheres()-1 );
+
+  vec3  lastPos    = world->sphere( last )->state.x;
+  float lastRadius = world->sphere( last )->radius;
+
+  world->removeSphere( first );
+
+  if (world->sphere( first ) != NULL)
+    return false;
+
+  Sphere *s = world->sphere( last );
+  if (s == NULL || s->radius != lastRadius || s->state.x != lastPos)
+    return false;
+
+  world->removeSphere( last );
+
+  return world->sphere( last ) == NULL;
+}
+
+
+static void usage( char *progName )
+
+{
+  cerr << "Usage: " << progName << " [-t seconds] [-brute] [-toi] [-events] [-local] [-batch] [-swept] [-simd level] [-threads n] [-nosleep] [-nozeno] [-noseparate] [-maxsteps n]" << endl
+       << "              [-integrator name] [-dt seconds] [-adaptive [min max]] [-noalloc] [-energy] [-handles] [-o outFile] [sceneFile]" << endl;
+  exit(1);
+}
+
+
+int main( int argc, char **argv )
+
+{
+  float simSeconds = DEFAULT_SIM_SECONDS;
+  char *sceneFile  = NULL;
+  char *outFile    = NULL;
+  bool  bruteForce = false;
+  bool  toi        = false;
+  bool  events     = false;
+  bool  local      = false;
+  bool  batch      = false;
+  bool  swept      = false;
+  bool  noAlloc    = false;
+  bool  energy     = false;
+  bool  handles    = false;
+  int   numThreads = 0;
+  bool  noSleep    = false;
+  bool  noZeno     = false;
+  bool  noSeparate = false;
+  int   maxSteps   = 0;
+  float timeStep   = 0;
+  int   integrator = -1;
+  bool  adaptive   = false;
+  float minStep    = 0;
+  float maxStep    = 0;
+
+  for (int i=1; i<argc; i++)
+    if (strcmp( argv[i], "-t" ) == 0 && i+1 < argc)
+      simSeconds = atof( argv[++i] );
+    else if (strcmp( argv[i], "-o" ) == 0 && i+1 < argc)
+      outFile = argv[++i];
+    else if (strcmp( argv[i], "-brute" ) == 0)
+      bruteForce = true;
+    else if (strcmp( argv[i], "-toi" ) == 0)
+      toi = true;
+    else if (strcmp( argv[i], "-events" ) == 0)
+      events = true;
+    else if (strcmp( argv[i], "-local" ) == 0)
+      local = true;
+    else if (strcmp( argv[i], "-batch" ) == 0)
+      batch = true;
+    else if (strcmp( argv[i], "-swept" ) == 0)
+      swept = true;
+    else if (strcmp( argv[i], "-threads" ) == 0 && i+1 < argc)
+      numThreads = atoi( argv[++i] );
+    else if (strcmp( argv[i], "-nosleep" ) == 0)
+      noSleep = true;
+    else if (strcmp( argv[i], "-nozeno" ) == 0)
+      noZeno = true;
+    else if (strcmp( argv[i], "-noseparate" ) == 0)
+      noSeparate = true;
+    else if (strcmp( argv[i], "-maxsteps" ) == 0 && i+1 < argc)
+      maxSteps = atoi( argv[++i] );
+    else if (strcmp( argv[i], "-dt" ) == 0 && i+1 < argc)
+      timeStep = atof( argv[++i] );
+    else if (strcmp( argv[i], "-adaptive" ) == 0) {
+      adaptive = true;
+      if (i+2 < argc && isNumber( argv[i+1] ) && isNumber( argv[i+2] )) {
+	minStep = atof( argv[++i] );
+	maxStep = atof( argv[++i] );
+      }
+    }
+    else if (strcmp( argv[i], "-integrator" ) == 0 && i+1 < argc) {
+      i++;
+      for (int k=0; k<NUM_INTEGRATORS; k++)
+	if (strcmp( argv[i], integratorName( (IntegratorType) k ) ) == 0)
+	  integrator = k;
+      if (integrator < 0)
+	usage( argv[0] );
+    }
+    else if (strcmp( argv[i], "-noalloc" ) == 0)
+      noAlloc = true;
+    else if (strcmp( argv[i], "-energy" ) == 0)
+      energy = true;
+    else if (strcmp( argv[i], "-handles" ) == 0)
+      handles = true;
+    else if (strcmp( argv[i], "-simd" ) == 0 && i+1 < argc) {
+      i++;
+      if (strcmp( argv[i], "scalar" ) == 0)
+	setSimdLevel( SIMD_SCALAR );
+      else if (strcmp( argv[i], "sse" ) == 0)
+	setSimdLevel( SIMD_SSE );
+      else if (strcmp( argv[i], "avx2" ) == 0)
+	setSimdLevel( SIMD_AVX2 );
+      else
+	usage( argv[0] );
+    }
+    else if (argv[i][0] == '-')
+      usage( argv[0] );
+    else
+      sceneFile = argv[i];
+
+  World *world = new World( sceneFile );
+
+  if (bruteForce)
+    world->broadphase = BRUTE_FORCE;
+
+  if (toi)
+    world->collisionTime = ANALYTIC_TOI;
+
+  if (events)
+    world->collisionTime = EVENT_DRIVEN;
+
+  if (local)
+    world->localRewind = true;
+
+  if (batch)
+    world->batchContacts = true;
+
+  if (swept)
+    world->sweptCollisions = true;
+
+  if (noSleep)
+    world->allowSleeping = false;
+
+  if (noZeno)
+    world->restZenoBounces = false;
+
+  if (noSeparate)
+    world->separateRestingContacts = false;
+
+  if (numThreads > 0)
+    world->setNumThreads( numThreads );
+
+  if (maxSteps > 0)
+    world->maxStepsPerFrame = maxSteps;
+
+  if (timeStep > 0)
+    world->timeStep = timeStep;
+
+  if (integrator >= 0)
+    world->setIntegrator( (IntegratorType) integrator );
+
+  if (adaptive) {
+    world->adaptiveTimeStep = true;
+    if (maxStep > 0) {
+      world->minAdaptiveStep = minStep;
+      world->maxAdaptiveStep = maxStep;
+    }
+  }
+
+  int initSpheres = world->numSpheres();
+
+  seq<SphereHandle> initHandles;
+
+  if (handles)
+    for (int i=0; i<initSpheres; i++)
+      initHandles.add( world->sphereHandle( i ) );
+
+  // Run
+
+  double startTime = wallTime();
+
+  float simTime = 0;
+  int   nFrames = 0;
+
+  long firstFrameAllocations = 0;
+
+  float startEnergy = world->totalEnergy();
+  float frameEnergy = startEnergy;
+  float maxRise     = 0;  // largest rise in energy over a frame
+
+  while (simTime < simSeconds) {
+    world->updateState( FRAME_TIME );
+    simTime += FRAME_TIME;
+    nFrames++;
+    if (nFrames == 1)
+      firstFrameAllocations = numAllocations;
+    if (energy) {
+      float e = world->totalEnergy();
+      if (e - frameEnergy > maxRise)
+	maxRise = e - frameEnergy;
+      frameEnergy = e;
+    }
+  }
+
+  long stepAllocations = numAllocations - firstFrameAllocations;  // after the first frame
+
+  double wallSeconds = wallTime() - startTime;
+
+  // Report.  Rates are per simulated second actually simulated, which
+  // excludes the time dropped by over-budget frames.
+
+  float simulated = simTime - world->droppedTime;
+
+  cout << "spheres:        " << initSpheres << " (" << world->numSpheres() << " remaining, " << world->numSleeping() << " asleep)" << endl
+       << "simulated time: " << simulated << " s in " << nFrames << " frames of " << FRAME_TIME << " s" << endl
+       << "wall time:      " << wallSeconds << " s" << endl
+       << "simd:           " << simdLevelName( simdLevel() ) << endl
+       << "threads:        " << world->numThreads() << endl;
+  if (world->collisionTime == EVENT_DRIVEN)
+    cout << "integrator:     none, event-driven in steps of at most " << world->maxAdaptiveStep << endl;
+  else {
+    cout << "integrator:     " << integratorName( world->integratorType() ) << ", dt ";
+    if (world->adaptiveTimeStep)
+      cout << "adaptive in [" << world->minAdaptiveStep << "," << world->maxAdaptiveStep << "]" << endl;
+    else
+      cout << world->timeStep << endl;
+  }
+  cout
+       << "steps:          " << world->numSteps << (world->collisionTime == EVENT_DRIVEN ? " (including collisions)" : "") << endl
+       << "steps/sec:      " << world->numSteps / wallSeconds << endl
+       << "collisions:     " << world->numCollisions << " (" << world->numCollisions / (initSpheres * (double) simulated) << " per sphere per sim s)" << endl
+       << "sim s/wall s:   " << simulated / wallSeconds << endl
+       << "over budget:    " << world->overBudgetFrames << " frames (max " << world->maxStepsPerFrame << " steps/frame), "
+       << world->droppedTime << " sim s dropped" << endl
+       << "allocations:    " << stepAllocations << " after the first frame" << endl;
+  if (energy)
+    cout << "energy:         " << startEnergy << " J at start, " << frameEnergy << " J at end, "
+	 << "largest rise in a frame " << maxRise << " J" << endl;
+
+  if (outFile != NULL)
+    world->writeSpheres( outFile );
+
+  if (handles && !checkHandles( world, initHandles )) {
+    cerr << "simrun: a sphere handle does not name its sphere" << endl;
+    return 4;
+  }
+
+  if (noAlloc && stepAllocations > 0) {
+    cerr << "simrun: " << stepAllocations << " heap allocations after the first frame" << endl;
+    return 2;
+  }
+
+  if (energy && maxRise > ENERGY_TOLERANCE * fabs( startEnergy )) {
+    cerr << "simrun: total energy rose by up to " << maxRise << " J in a frame" << endl;
+    return 3;
+  }
+
+  return 0;
+}
@@ -15,34 +15,39 @@ float Sphere::distToSphere( Sphere &otherSphere )
 
 
 
-// Return the distance between 'this' sphere and 'rectangle'.  Also
-// set 'closestPoint' to the point on the rectangle that is closest to
-// the sphere.
+// Return the distance between the sphere with the given centre and
+// radius and 'rectangle'.  Also set 'closestPoint' to the point on the
+// rectangle that is closest to the sphere.
+//
+// This takes the centre and radius (from World's SphereStateArrays)
+// rather than reading a Sphere object.
 
-float Sphere::distToRectangle( Rectangle &rectangle, vec3 *closestPoint )
+float Sphere::distToRectangle( vec3 centre, float radius, Rectangle &rectangle, vec3 *closestPoint )
 
 {
   // Find transform that moves rectangle back to [-xDim/2,+xDim/2] x [-yDim/2,+yDim/2] x [0] centred at origin with normal = z
+  //
+  // This is the rectangle's cached rigid transform.
 
-  mat4 Minv = rectangle.OCS_to_WCS().inverse();
+  const RectangleFrame &frame = rectangle.frame();
 
   // Apply same to sphere centre.  Now the sphere centre is in the
   // coordinate system of the rectangle, which has the dimensions
   // rectangle.xDim x rectangle.yDim, centre at (0,0,0), and normal
   // (0,0,1).
 
-  vec3 sphereCentre = (Minv * vec4( this->state.x, 1.0 )).toVec3();
+  vec3 sphereCentre = frame.toLocal( centre );
 
   // If the z projection of the sphere is inside the xy rectangle,
   // find the closestPoint and the distance.
 
   // [YOUR CODE HERE: REPLACE THE CODE BELOW]
-  float xDim = rectangle.xDim/2;
-  float yDim = rectangle.yDim/2;
+  float xDim = frame.halfX;
+  float yDim = frame.halfY;
   if (sphereCentre.x >= -xDim && sphereCentre.x <= xDim && sphereCentre.y >= -yDim && sphereCentre.y <= yDim) { 
     vec3 localClosestPoint = vec3(sphereCentre.x, sphereCentre.y, 0);
-    *closestPoint = (rectangle.OCS_to_WCS() * vec4(localClosestPoint, 1.0)).toVec3();
-    float distance = fabs(sphereCentre.z) - this->radius;
+    *closestPoint = frame.toWorld( localClosestPoint );
+    float distance = fabs(sphereCentre.z) - radius;
     return std::max(0.0f, distance);
   }
 
@@ -94,211 +99,7 @@ float Sphere::distToRectangle( Rectangle &rectangle, vec3 *closestPoint )
   
  // [YOUR CODE HERE: REPLACE THE CODE BELOW]
 
-  *closestPoint = (rectangle.OCS_to_WCS() * vec4(pt, 1.0)).toVec3();
-
-  return std::max(0.0f, min - this->radius);
-}
-
-
-
-// icosahedron vertices (taken from Jon Leech http://www.cs.unc.edu/~jon)
-
-vec3 Sphere::icosahedronVerts[NUM_VERTS] = {
-  vec3(  tau,  one,    0 ),
-  vec3( -tau,  one,    0 ),
-  vec3( -tau, -one,    0 ),
-  vec3(  tau, -one,    0 ),
-  vec3(  one,   0 ,  tau ),
-  vec3(  one,   0 , -tau ),
-  vec3( -one,   0 , -tau ),
-  vec3( -one,   0 ,  tau ),
-  vec3(   0 ,  tau,  one ),
-  vec3(   0 , -tau,  one ),
-  vec3(   0 , -tau, -one ),
-  vec3(   0 ,  tau, -one )
-};
-
-
-// icosahedron faces (taken from Jon Leech http://www.cs.unc.edu/~jon)
-
-int Sphere::icosahedronFaces[NUM_FACES][3] = {
-  { 4, 8, 7 },
-  { 4, 7, 9 },
-  { 5, 6, 11 },
-  { 5, 10, 6 },
-  { 0, 4, 3 },
-  { 0, 3, 5 },
-  { 2, 7, 1 },
-  { 2, 1, 6 },
-  { 8, 0, 11 },
-  { 8, 11, 1 },
-  { 9, 10, 3 },
-  { 9, 2, 10 },
-  { 8, 4, 0 },
-  { 11, 0, 5 },
-  { 4, 9, 3 },
-  { 5, 3, 10 },
-  { 7, 8, 1 },
-  { 6, 1, 11 },
-  { 7, 2, 9 },
-  { 6, 10, 2 },
-};
-
-
-// Add a level to the sphere
-
-void Sphere::refine()
-
-{
-  int n = faces.size();
-
-  for (int i=0; i<n; i++) {
-
-    SphereFace f = faces[i];
-
-    verts.add( (verts[ f.v[0] ] + verts[ f.v[1] ]).normalize() );
-    verts.add( (verts[ f.v[1] ] + verts[ f.v[2] ]).normalize() );
-    verts.add( (verts[ f.v[2] ] + verts[ f.v[0] ]).normalize() );
-
-    int v01 = verts.size() - 3;
-    int v12 = verts.size() - 2;
-    int v20 = verts.size() - 1;
-
-    faces.add( SphereFace( f.v[0], v01, v20 ) );
-    faces.add( SphereFace( f.v[1], v12, v01 ) );
-    faces.add( SphereFace( f.v[2], v20, v12 ) );
-
-    faces[i].v[0] = v01;
-    faces[i].v[1] = v12;
-    faces[i].v[2] = v20;
-  }
-}
-
-
-void Sphere::setupVAO()
-
-{
-  // Create a VAO
-
-  glGenVertexArrays( 1, &VAO );
-  glBindVertexArray( VAO );
-
-  // store vertices (i.e. one triple of floats per vertex)
-
-  GLuint vertexBufferID;
-  glGenBuffers( 1, &vertexBufferID );
-  glBindBuffer( GL_ARRAY_BUFFER, vertexBufferID );
-
-  glBufferData( GL_ARRAY_BUFFER, verts.size() * sizeof(vec3), (void*) &verts[0], GL_STATIC_DRAW );
-
-  glEnableVertexAttribArray( 0 );
-  glVertexAttribPointer( 0, 3, GL_FLOAT, GL_FALSE, 0, 0 );
-
-  // Set up face indices.  These are collected from the sphere's
-  // 'seq<vec3> verts' and 'seq<SphereFace> faces' structures.
-
-  GLuint *indexBuffer = new GLuint[ faces.size() * 3 ];
-
-  for (int i=0; i<faces.size(); i++) {
-
-    // Determine whether vertices are CW or CCW
-
-    vec3 normal = 1/3.0 * (verts[faces[i].v[0]] + verts[faces[i].v[1]] + verts[faces[i].v[2]] );
-    vec3 cross = (verts[faces[i].v[1]] - verts[faces[i].v[0]]) ^ (verts[faces[i].v[2]] - verts[faces[i].v[0]]);
-
-    if (normal * cross > 0) // CW
-      for (int j=0; j<3; j++) 
-	indexBuffer[3*i+j] = faces[i].v[j]; 
-    else // CCW
-      for (int j=2; j>=0; j--) 
-	indexBuffer[3*i+j] = faces[i].v[j]; 
-  }
-
-  // store faces (i.e. one triple of vertex indices per face)
+  *closestPoint = frame.toWorld( pt );
 
-  GLuint indexBufferID;
-  glGenBuffers( 1, &indexBufferID );
-  glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, indexBufferID );
-  glBufferData( GL_ELEMENT_ARRAY_BUFFER, faces.size() * 3 * sizeof(GLuint), indexBuffer, GL_STATIC_DRAW );
-
-  // Clean up
-
-  delete[] indexBuffer;
-
-  glBindBuffer( GL_ARRAY_BUFFER, 0 );
-  glBindVertexArray( 0 );
-}
-
-
-void Sphere::draw( mat4 &WCS_to_VCS, mat4 &VCS_to_CCS, vec3 &lightDir, vec3 &colour )
-
-{
-  mat4 MV  = WCS_to_VCS * OCS_to_WCS() * scale( radius, radius, radius );
-  mat4 MVP = VCS_to_CCS * MV;
-
-  gpu->activate();
-
-  gpu->setMat4( "MV", MV );
-  gpu->setMat4( "MVP", MVP );
-  gpu->setVec3( "colour", colour );
-  gpu->setVec3( "lightDir", lightDir );
-  
-  // Draw using element array
-
-  glBindVertexArray( VAO );
-  glDrawElements( GL_TRIANGLES, faces.size()*3, GL_UNSIGNED_INT, 0 );
-  glBindVertexArray( 0 );
-
-  gpu->deactivate();
+  return std::max(0.0f, min - radius);
 }
-
-
-const char *Sphere::vertShader = R"XX(
-
-  #version 300 es
-
-  precision mediump float;
-
-  uniform mat4 MVP;
-  uniform mat4 MV;
-
-  layout (location = 0) in vec3 vertPosition;
-
-  smooth out vec3 normal;
-
-  void main() {
-
-    gl_Position = MVP * vec4( vertPosition, 1.0 );
-
-    normal = vec3( MV * vec4( vertPosition, 0.0 ) );  // positions are on unit sphere, so positions == normals
-  }
-)XX";
-
-
-const char *Sphere::fragShader = R"XX(
-
-  #version 300 es
-
-  precision mediump float;
-
-  uniform vec3 colour;
-  uniform vec3 lightDir;
-
-  smooth in vec3 normal;
-  out vec4 outputColour;
-
-  void main() {
-
-    float NdotL = dot( normalize(normal), lightDir );
-
-    if (NdotL < 0.1)
-      NdotL = 0.1; // some ambient
-
-    outputColour = vec4( NdotL * colour, 1.0 );
-  }
-)XX";
-
-
-
-
-
@@ -0,0 +1,182 @@
+// sphereMesh.cpp
+
+
+#include "sphereMesh.h"
+
+
+// icosahedron vertices (taken from Jon Leech http://www.cs.unc.edu/~jon)
+
+#define tau 0.8506508084      /* t=(1+sqrt(5))/2, tau=t/sqrt(1+t^2)  */
+#define one 0.5257311121      /* one=1/sqrt(1+t^2) , unit sphere     */
+
+#define NUM_VERTS 12
+#define NUM_FACES 20
+
+
+vec3 SphereMesh::icosahedronVerts[NUM_VERTS] = {
+  vec3(  tau,  one,    0 ),
+  vec3( -tau,  one,    0 ),
+  vec3( -tau, -one,    0 ),
+  vec3(  tau, -one,    0 ),
+  vec3(  one,   0 ,  tau ),
+  vec3(  one,   0 , -tau ),
+  vec3( -one,   0 , -tau ),
+  vec3( -one,   0 ,  tau ),
+  vec3(   0 ,  tau,  one ),
+  vec3(   0 , -tau,  one ),
+  vec3(   0 , -tau, -one ),
+  vec3(   0 ,  tau, -one )
+};
+
+
+// icosahedron faces (taken from Jon Leech http://www.cs.unc.edu/~jon)
+
+int SphereMesh::icosahedronFaces[NUM_FACES][3] = {
+  { 4, 8, 7 },
+  { 4, 7, 9 },
+  { 5, 6, 11 },
+  { 5, 10, 6 },
+  { 0, 4, 3 },
+  { 0, 3, 5 },
+  { 2, 7, 1 },
+  { 2, 1, 6 },
+  { 8, 0, 11 },
+  { 8, 11, 1 },
+  { 9, 10, 3 },
+  { 9, 2, 10 },
+  { 8, 4, 0 },
+  { 11, 0, 5 },
+  { 4, 9, 3 },
+  { 5, 3, 10 },
+  { 7, 8, 1 },
+  { 6, 1, 11 },
+  { 7, 2, 9 },
+  { 6, 10, 2 },
+};
+
+
+SphereMesh *SphereMesh::meshes[ MAX_SPHERE_MESH_LEVELS+1 ] = { NULL };
+
+
+// Return the mesh refined numLevels times, building it if this is
+// the first request for it
+
+SphereMesh *SphereMesh::get( int numLevels )
+
+{
+  if (numLevels < 0)
+    numLevels = 0;
+  else if (numLevels > MAX_SPHERE_MESH_LEVELS)
+    numLevels = MAX_SPHERE_MESH_LEVELS;
+
+  if (meshes[numLevels] == NULL)
+    meshes[numLevels] = new SphereMesh( numLevels );
+
+  return meshes[numLevels];
+}
+
+
+SphereMesh::SphereMesh( int levels )
+
+{
+  numLevels = levels;
+
+  for (int i=0; i<NUM_VERTS; i++)
+    verts.add( icosahedronVerts[i].normalize() );
+
+  for (int i=0; i<NUM_FACES; i++)
+    faces.add( SphereFace( icosahedronFaces[i][0],
+			   icosahedronFaces[i][1],
+			   icosahedronFaces[i][2] ) );
+
+  for (int i=0; i<numLevels; i++)
+    refine();
+}
+
+
+// Map from an edge (a pair of vertex indices) to the index of the
+// vertex at its midpoint.  This is an open-addressed hash table with
+// linear probing, sized to stay under half full.
+
+class EdgeMidpoints {
+
+  unsigned long long *keys;
+  int                *mids;  // -1 if the slot is empty
+  unsigned int        mask;
+
+ public:
+
+  EdgeMidpoints( int numEdges ) {
+
+    unsigned int size = 1;
+    while (size < 2 * (unsigned int) numEdges)
+      size *= 2;
+
+    mask = size-1;
+
+    keys = new unsigned long long[ size ];
+    mids = new int[ size ];
+
+    for (unsigned int i=0; i<size; i++)
+      mids[i] = -1;
+  }
+
+  ~EdgeMidpoints() {
+    delete [] keys;
+    delete [] mids;
+  }
+
+  // Return the midpoint of edge v0-v1, adding it to 'verts' if this
+  // is the first time the edge has been seen
+
+  int midpoint( unsigned int v0, unsigned int v1, seq<vec3> &verts ) {
+
+    unsigned long long key = (v0 < v1)
+      ? ((unsigned long long) v0 << 32) | v1
+      : ((unsigned long long) v1 << 32) | v0;
+
+    unsigned int slot = (unsigned int) ((key * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+
+    while (mids[slot] != -1) {
+      if (keys[slot] == key)
+	return mids[slot];
+      slot = (slot+1) & mask;
+    }
+
+    verts.add( (verts[v0] + verts[v1]).normalize() );
+
+    keys[slot] = key;
+    mids[slot] = verts.size() - 1;
+
+    return mids[slot];
+  }
+};
+
+
+// Add a level to the sphere.  Each face is split into four, with a
+// new vertex at the midpoint of each edge.
+
+void SphereMesh::refine()
+
+{
+  int n = faces.size();
+
+  EdgeMidpoints edgeMidpoints( 3*n/2 );  // each edge is on two faces
+
+  for (int i=0; i<n; i++) {
+
+    SphereFace f = faces[i];
+
+    int v01 = edgeMidpoints.midpoint( f.v[0], f.v[1], verts );
+    int v12 = edgeMidpoints.midpoint( f.v[1], f.v[2], verts );
+    int v20 = edgeMidpoints.midpoint( f.v[2], f.v[0], verts );
+
+    faces.add( SphereFace( f.v[0], v01, v20 ) );
+    faces.add( SphereFace( f.v[1], v12, v01 ) );
+    faces.add( SphereFace( f.v[2], v20, v12 ) );
+
+    faces[i].v[0] = v01;
+    faces[i].v[1] = v12;
+    faces[i].v[2] = v20;
+  }
+}
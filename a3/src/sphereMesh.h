@@ -0,0 +1,59 @@
+// sphereMesh.h
+//
+// Unit icosphere meshes, refined from an icosahedron.
+//
+// Each mesh is built once, on its first use, and then shared:
+//
+//   SphereMesh *mesh = SphereMesh::get( SPHERE_LEVELS );
+//
+// Refinement splits each face into four.  The midpoint of an edge is
+// shared by the two faces on that edge, so it is made only once.  A
+// mesh refined L times therefore has 10*4^L + 2 vertices and 20*4^L
+// faces.
+//
+// get() is not thread safe.  It is only called from the drawing
+// thread.
+
+
+#ifndef SPHERE_MESH_H
+#define SPHERE_MESH_H
+
+#include "headers.h"
+#include "linalg.h"
+#include "seq.h"
+
+
+#define MAX_SPHERE_MESH_LEVELS 8  // 1.3 million faces
+
+
+class SphereFace {
+ public:
+  unsigned int v[3];
+  SphereFace() {}
+  SphereFace( int v0, int v1, int v2 ) {
+    v[0] = v0; v[1] = v1; v[2] = v2;
+  }
+};
+
+
+class SphereMesh {
+
+  static SphereMesh *meshes[ MAX_SPHERE_MESH_LEVELS+1 ];  // indexed by number of levels; NULL until built
+
+  static vec3 icosahedronVerts[];
+  static int  icosahedronFaces[][3];
+
+  SphereMesh( int numLevels );
+
+  void refine();
+
+ public:
+
+  int             numLevels;
+  seq<vec3>       verts;  // on the unit sphere, so also the normals
+  seq<SphereFace> faces;
+
+  static SphereMesh *get( int numLevels );
+};
+
+#endif
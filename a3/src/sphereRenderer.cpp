@@ -0,0 +1,241 @@
+// sphereRenderer.cpp
+
+
+#include "sphereRenderer.h"
+
+#include <cstddef>
+
+
+#define MIN_INSTANCE_CAPACITY 64
+
+
+// Set up the GPU resources for the mesh refined numLevels times from
+// the icosahedron
+
+SphereRenderer::SphereRenderer( int numLevels )
+
+{
+  mesh = SphereMesh::get( numLevels );
+
+  gpu = new GPUProgram();
+  gpu->init( vertShader, fragShader, "in sphereRenderer.cpp" );
+
+  instances = NULL;
+  numInstances = 0;
+  capacity = 0;
+  bufferCapacity = 0;
+
+  setupVAO();
+}
+
+
+SphereRenderer::~SphereRenderer()
+
+{
+  GPUProgram::bindVAO( 0 );
+
+  glDeleteBuffers( 1, &vertexBufferID );
+  glDeleteBuffers( 1, &indexBufferID );
+  glDeleteBuffers( 1, &instanceBufferID );
+  glDeleteVertexArrays( 1, &VAO );
+
+  delete gpu;
+  delete [] instances;
+}
+
+
+// Set up the VAO with the mesh and the (so far empty) instance buffer
+
+void SphereRenderer::setupVAO()
+
+{
+  // Create a VAO
+
+  glGenVertexArrays( 1, &VAO );
+  GPUProgram::bindVAO( VAO );
+
+  // store vertices (i.e. one triple of floats per vertex)
+
+  glGenBuffers( 1, &vertexBufferID );
+  glBindBuffer( GL_ARRAY_BUFFER, vertexBufferID );
+
+  seq<vec3>       &verts = mesh->verts;
+  seq<SphereFace> &faces = mesh->faces;
+
+  glBufferData( GL_ARRAY_BUFFER, verts.size() * sizeof(vec3), (void*) &verts[0], GL_STATIC_DRAW );
+
+  glEnableVertexAttribArray( 0 );
+  glVertexAttribPointer( 0, 3, GL_FLOAT, GL_FALSE, 0, 0 );
+
+  // Per-instance attributes: centre, radius and colour, which advance
+  // once per instance rather than once per vertex
+
+  glGenBuffers( 1, &instanceBufferID );
+  glBindBuffer( GL_ARRAY_BUFFER, instanceBufferID );
+
+  glEnableVertexAttribArray( 1 );
+  glVertexAttribPointer( 1, 3, GL_FLOAT, GL_FALSE, sizeof(SphereInstance), (void*) offsetof( SphereInstance, centre ) );
+  glVertexAttribDivisor( 1, 1 );
+
+  glEnableVertexAttribArray( 2 );
+  glVertexAttribPointer( 2, 1, GL_FLOAT, GL_FALSE, sizeof(SphereInstance), (void*) offsetof( SphereInstance, radius ) );
+  glVertexAttribDivisor( 2, 1 );
+
+  glEnableVertexAttribArray( 3 );
+  glVertexAttribPointer( 3, 3, GL_FLOAT, GL_FALSE, sizeof(SphereInstance), (void*) offsetof( SphereInstance, colour ) );
+  glVertexAttribDivisor( 3, 1 );
+
+  // Set up face indices.  These are collected from the mesh's
+  // 'seq<vec3> verts' and 'seq<SphereFace> faces' structures.
+
+  GLuint *indexBuffer = new GLuint[ faces.size() * 3 ];
+
+  for (int i=0; i<faces.size(); i++) {
+
+    // Determine whether vertices are CW or CCW
+
+    vec3 normal = 1/3.0 * (verts[faces[i].v[0]] + verts[faces[i].v[1]] + verts[faces[i].v[2]] );
+    vec3 cross = (verts[faces[i].v[1]] - verts[faces[i].v[0]]) ^ (verts[faces[i].v[2]] - verts[faces[i].v[0]]);
+
+    if (normal * cross > 0) // CW
+      for (int j=0; j<3; j++)
+	indexBuffer[3*i+j] = faces[i].v[j];
+    else // CCW
+      for (int j=2; j>=0; j--)
+	indexBuffer[3*i+j] = faces[i].v[j];
+  }
+
+  // store faces (i.e. one triple of vertex indices per face)
+
+  glGenBuffers( 1, &indexBufferID );
+  glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, indexBufferID );
+  glBufferData( GL_ELEMENT_ARRAY_BUFFER, faces.size() * 3 * sizeof(GLuint), indexBuffer, GL_STATIC_DRAW );
+
+  // Clean up
+
+  delete[] indexBuffer;
+
+  glBindBuffer( GL_ARRAY_BUFFER, 0 );
+  GPUProgram::bindVAO( 0 );
+}
+
+
+// Add a sphere to be drawn.  The array grows by doubling and is kept
+// between frames.
+
+void SphereRenderer::add( vec3 centre, float radius, vec3 colour )
+
+{
+  if (numInstances == capacity) {
+
+    int newCapacity = (capacity > 0 ? 2 * capacity : MIN_INSTANCE_CAPACITY);
+
+    SphereInstance *newInstances = new SphereInstance[ newCapacity ];
+
+    for (int i=0; i<numInstances; i++)
+      newInstances[i] = instances[i];
+
+    delete [] instances;
+    instances = newInstances;
+    capacity = newCapacity;
+  }
+
+  SphereInstance &s = instances[ numInstances++ ];
+
+  s.centre = centre;
+  s.radius = radius;
+  s.colour = colour;
+}
+
+
+// Draw all of the spheres added since the last clear()
+
+void SphereRenderer::draw( mat4 &WCS_to_VCS, mat4 &VCS_to_CCS, vec3 &lightDir )
+
+{
+  if (numInstances == 0)
+    return;
+
+  // Upload the instances.  Respecifying the buffer's storage first
+  // ("orphaning") lets the driver give it new memory rather than wait
+  // for the last frame's draw to finish reading it.
+
+  glBindBuffer( GL_ARRAY_BUFFER, instanceBufferID );
+
+  if (numInstances > bufferCapacity)
+    bufferCapacity = capacity;
+
+  glBufferData( GL_ARRAY_BUFFER, bufferCapacity * sizeof(SphereInstance), NULL, GL_STREAM_DRAW );
+  glBufferSubData( GL_ARRAY_BUFFER, 0, numInstances * sizeof(SphereInstance), instances );
+
+  glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+  // Draw
+
+  mat4 MVP = VCS_to_CCS * WCS_to_VCS;
+
+  gpu->activate();
+
+  gpu->setMat4( "MV", WCS_to_VCS );
+  gpu->setMat4( "MVP", MVP );
+  gpu->setVec3( "lightDir", lightDir );
+
+  GPUProgram::bindVAO( VAO );
+  glDrawElementsInstanced( GL_TRIANGLES, mesh->faces.size()*3, GL_UNSIGNED_INT, 0, numInstances );
+
+  gpu->deactivate();
+}
+
+
+// Each vertex is placed on its instance's sphere in the WCS.  Spheres
+// are uniformly coloured, so their orientations are not needed.
+
+const char *SphereRenderer::vertShader = R"XX(
+
+  #version 300 es
+
+  precision mediump float;
+
+  uniform mat4 MVP;
+  uniform mat4 MV;
+
+  layout (location = 0) in vec3 vertPosition;
+  layout (location = 1) in vec3 instanceCentre;
+  layout (location = 2) in float instanceRadius;
+  layout (location = 3) in vec3 instanceColour;
+
+  smooth out vec3 normal;
+  flat out vec3 colour;
+
+  void main() {
+
+    gl_Position = MVP * vec4( instanceCentre + instanceRadius * vertPosition, 1.0 );
+
+    normal = vec3( MV * vec4( vertPosition, 0.0 ) );  // positions are on unit sphere, so positions == normals
+    colour = instanceColour;
+  }
+)XX";
+
+
+const char *SphereRenderer::fragShader = R"XX(
+
+  #version 300 es
+
+  precision mediump float;
+
+  uniform vec3 lightDir;
+
+  smooth in vec3 normal;
+  flat in vec3 colour;
+  out vec4 outputColour;
+
+  void main() {
+
+    float NdotL = dot( normalize(normal), lightDir );
+
+    if (NdotL < 0.1)
+      NdotL = 0.1; // some ambient
+
+    outputColour = vec4( NdotL * colour, 1.0 );
+  }
+)XX";
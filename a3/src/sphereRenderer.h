@@ -0,0 +1,73 @@
+// sphereRenderer.h
+//
+// Draws all of the spheres with one mesh, one GPUProgram and one
+// instanced draw call.
+//
+// The mesh is the shared unit icosphere from SphereMesh.  Each sphere is an instance of it,
+// with its own centre, radius and colour, which are streamed into an
+// instance buffer every frame.  So the setup cost is the same for any
+// number of spheres, and a frame costs one buffer upload and one draw
+// call.
+//
+//   SphereRenderer *renderer = new SphereRenderer( SPHERE_LEVELS );  // (needs a GL context)
+//
+//   renderer->clear();
+//   renderer->add( centre, radius, colour );  // for each sphere
+//   renderer->draw( WCS_to_VCS, VCS_to_CCS, lightDir );
+
+
+#ifndef SPHERE_RENDERER_H
+#define SPHERE_RENDERER_H
+
+#include "headers.h"
+#include "linalg.h"
+#include "gpuProgram.h"
+#include "sphereMesh.h"
+
+
+// Per-instance attributes, as laid out in the instance buffer
+
+class SphereInstance {
+ public:
+  vec3  centre;
+  float radius;
+  vec3  colour;
+};
+
+
+class SphereRenderer {
+
+  SphereMesh *mesh;  // shared; not owned
+
+  GLuint VAO;
+  GLuint vertexBufferID;
+  GLuint indexBufferID;
+  GLuint instanceBufferID;
+
+  GPUProgram *gpu;
+
+  SphereInstance *instances;  // to be drawn
+  int             numInstances;
+  int             capacity;        // of 'instances'
+  int             bufferCapacity;  // of the instance buffer, in instances
+
+  static const char *vertShader;
+  static const char *fragShader;
+
+  void setupVAO();
+
+ public:
+
+  SphereRenderer( int numLevels );
+  ~SphereRenderer();
+
+  void clear() {
+    numInstances = 0;
+  }
+
+  void add( vec3 centre, float radius, vec3 colour );
+
+  void draw( mat4 &WCS_to_VCS, mat4 &VCS_to_CCS, vec3 &lightDir );
+};
+
+#endif
@@ -0,0 +1,119 @@
+// sphereSlots.h
+//
+// Stable handles to spheres.
+//
+// World keeps its spheres packed: spheres[i] and index i of the
+// SphereStateArrays are the same sphere, for i < numSpheres().  So
+// removing a sphere moves others to new indices, and an index or a
+// Sphere* held across a removal can name the wrong sphere or none.
+// A SphereHandle names a sphere for as long as the sphere exists:
+//
+//   SphereHandle h = world->sphereHandle( i );
+//   ...
+//   Sphere *s = world->sphere( h );  // NULL if the sphere has been removed
+//
+// A handle is a slot and a generation.  The slot holds the index of
+// its sphere.  When the sphere is removed, the slot is freed for
+// reuse and its generation is incremented, so that handles to the
+// removed sphere no longer match it.
+//
+// SphereSlots is kept in step with the sphere arrays by World: add()
+// when a sphere is appended, move() when a sphere is moved to another
+// index, release() when a sphere is removed, and resize() when the
+// arrays are truncated.  All are O(1), apart from resize(), which is
+// O(number removed).  Only add() allocates.
+
+
+#ifndef SPHERE_SLOTS_H
+#define SPHERE_SLOTS_H
+
+#include "seq.h"
+
+
+class SphereHandle {
+ public:
+  int          slot;        // -1 for a handle that names no sphere
+  unsigned int generation;
+
+  SphereHandle() { slot = -1; generation = 0; }
+  SphereHandle( int s, unsigned int g ) { slot = s; generation = g; }
+};
+
+
+class SphereSlots {
+
+  seq<int>          slotIndex;       // index of each slot's sphere, or -1 if the slot is free
+  seq<unsigned int> slotGeneration;  // incremented when a slot is freed
+  seq<int>          freeSlots;
+  seq<int>          indexSlot;       // slot of the sphere at each index
+
+ public:
+
+  int size() {
+    return indexSlot.size();
+  }
+
+  // A sphere has been added at index size()
+
+  void add() {
+
+    int s;
+
+    if (freeSlots.size() > 0) {
+      s = freeSlots[ freeSlots.size()-1 ];
+      freeSlots.remove();
+    } else {
+      s = slotIndex.size();
+      slotIndex.add( -1 );
+      slotGeneration.add( 0 );
+      freeSlots.reserve( slotIndex.size() );  // so that release() never allocates
+    }
+
+    slotIndex[s] = indexSlot.size();
+    indexSlot.add( s );
+  }
+
+  SphereHandle handle( int i ) {
+    int s = indexSlot[i];
+    return SphereHandle( s, slotGeneration[s] );
+  }
+
+  // Index of the handle's sphere, or -1 if it has been removed
+
+  int index( SphereHandle h ) {
+    if (h.slot < 0 || h.slot >= slotIndex.size() || slotGeneration[h.slot] != h.generation)
+      return -1;
+    return slotIndex[h.slot];
+  }
+
+  // The sphere at index i has been removed.  Its index is left without
+  // a slot until another sphere is moved into it or the arrays are
+  // resized below it.
+
+  void release( int i ) {
+    int s = indexSlot[i];
+    slotIndex[s] = -1;
+    slotGeneration[s]++;
+    freeSlots.add( s );
+    indexSlot[i] = -1;
+  }
+
+  // The sphere at index 'from' has been moved to index 'to'
+
+  void move( int from, int to ) {
+    int s = indexSlot[from];
+    indexSlot[to] = s;
+    indexSlot[from] = -1;
+    slotIndex[s] = to;
+  }
+
+  // The arrays have been truncated to n spheres.  The spheres beyond
+  // n must already have been released or moved.
+
+  void resize( int n ) {
+    while (indexSlot.size() > n)
+      indexSlot.remove();
+  }
+};
+
+#endif
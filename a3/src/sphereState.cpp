@@ -0,0 +1,70 @@
+// sphereState.cpp
+
+
+#include "sphereState.h"
+#include <cstring>
+
+
+// Set the number of spheres.  Storage only grows, so snapshots that
+// are resized every step do not allocate once the number of spheres
+// has settled.
+
+void SphereStateArrays::resize( int newN )
+
+{
+  if (newN > capacity) {
+
+    int newCapacity = (capacity == 0 ? newN : 2 * capacity);
+    if (newCapacity < newN)
+      newCapacity = newN;
+
+    float        *newBlock  = new float[ NUM_KINEMATIC_COMPONENTS * newCapacity ];
+    float        *newRadius = new float[ newCapacity ];
+    unsigned int *newFlags  = new unsigned int[ newCapacity ];
+
+    for (int k=0; k<NUM_KINEMATIC_COMPONENTS; k++)
+      memcpy( newBlock + k * newCapacity, block + k * capacity, n * sizeof(float) );
+
+    memcpy( newRadius, radius, n * sizeof(float) );
+    memcpy( newFlags,  flags,  n * sizeof(unsigned int) );
+
+    delete [] block;
+    delete [] radius;
+    delete [] flags;
+
+    capacity = newCapacity;
+    block    = newBlock;
+    radius   = newRadius;
+    flags    = newFlags;
+
+    x  = kinematics(0);
+    y  = kinematics(1);
+    z  = kinematics(2);
+    vx = kinematics(3);
+    vy = kinematics(4);
+    vz = kinematics(5);
+  }
+
+  n = newN;
+}
+
+
+void SphereStateArrays::move( int from, int to )
+
+{
+  for (int k=0; k<NUM_KINEMATIC_COMPONENTS; k++)
+    kinematics(k)[to] = kinematics(k)[from];
+
+  radius[to] = radius[from];
+  flags[to]  = flags[from];
+}
+
+
+void SphereStateArrays::copyKinematics( const SphereStateArrays &from )
+
+{
+  resize( from.n );
+
+  for (int k=0; k<NUM_KINEMATIC_COMPONENTS; k++)
+    memcpy( kinematics(k), from.kinematics(k), n * sizeof(float) );
+}
@@ -0,0 +1,74 @@
+// sphereState.h
+//
+// Sphere state stored as a structure of arrays (SoA).
+//
+// The physics loops (integration, broadphase, collision tests) read
+// and write only these arrays, which are contiguous floats that the
+// compiler can vectorize.  Sphere i in World::spheres and index i here
+// are the same sphere; the Sphere object holds what is needed to draw
+// it, and its 'state' is a copy of x and v made after each update.
+//
+// x, y, z, vx, vy, vz are one block of six runs of 'capacity' floats,
+// so a component is found as kinematics(k), k = 0..5, in that order.
+// Snapshots used by the integrator copy only these.
+
+
+#ifndef SPHERE_STATE_H
+#define SPHERE_STATE_H
+
+#include "linalg.h"
+
+
+#define NUM_KINEMATIC_COMPONENTS 6  // x, y, z, vx, vy, vz
+
+#define SPHERE_CONSTRAINED 0x1  // flag: sphere has at least one constraint rectangle
+#define SPHERE_ASLEEP      0x2  // flag: sphere is at rest and is not moved (see World::putToSleep(), wake() and wakeApproachedSpheres())
+
+
+class SphereStateArrays {
+
+  int    capacity;
+  float *block;  // NUM_KINEMATIC_COMPONENTS * capacity floats
+
+  SphereStateArrays( const SphereStateArrays &source );               // not copyable
+  SphereStateArrays & operator = ( const SphereStateArrays &source );
+
+ public:
+
+  int n;  // number of spheres
+
+  float *x, *y, *z;     // centre
+  float *vx, *vy, *vz;  // velocity
+  float *radius;
+
+  unsigned int *flags;
+
+  SphereStateArrays() {
+    n = 0;
+    capacity = 0;
+    block = NULL;
+    x = y = z = vx = vy = vz = radius = NULL;
+    flags = NULL;
+  }
+
+  ~SphereStateArrays() {
+    delete [] block;
+    delete [] radius;
+    delete [] flags;
+  }
+
+  void resize( int newN );  // keeps the first min(n,newN) spheres
+  void move( int from, int to );  // copies sphere 'from' over sphere 'to'
+
+  void copyKinematics( const SphereStateArrays &from );  // x and v only; resizes to from.n
+
+  float *kinematics( int k ) const { return block + k * capacity; }
+
+  vec3 position( int i ) const { return vec3( x[i], y[i], z[i] ); }
+  vec3 velocity( int i ) const { return vec3( vx[i], vy[i], vz[i] ); }
+
+  void setPosition( int i, vec3 p ) { x[i] = p.x; y[i] = p.y; z[i] = p.z; }
+  void setVelocity( int i, vec3 v ) { vx[i] = v.x; vy[i] = v.y; vz[i] = v.z; }
+};
+
+#endif
@@ -8,9 +8,9 @@
 // Draw 'string' at position (x,y) in viewing coordinates
 // [-1,1]x[-1,1].  Scale the string to have height 'height'.
 //
-// We need 'transformLocation' to be the location at which to store
-// the transformation matrix for the GPU shader.  This is found by the
-// calling program using glGetUniformLocation().
+// The glyphs are in one vertex buffer built at startup, so a string
+// is drawn with one glDrawArrays per character and no GL objects or
+// memory are allocated.
 
 
 #include "strokefont.h"
@@ -25,12 +25,13 @@ char *StrokeFont::fontVertexShader = R"XX(
   #version 300 es
 
   layout (location = 0) in vec4 position;
-  uniform mat4 MVP;
+  uniform mat4 MVP;          // glyph to string frame (rotated and scaled)
+  uniform vec2 glyphOrigin;  // position of the glyph's string frame
 
   void main()
 
   {
-     gl_Position = MVP * position;
+     gl_Position = MVP * position + vec4( glyphOrigin, 0, 0 );
   }
 
 )XX";
@@ -53,7 +54,81 @@ char *StrokeFont::fontFragmentShader = R"XX(
 
 
 
-void StrokeFont::drawStrokeString( string str, float x, float y, float height, float theta, Alignment alignment )
+// Pack the vertices of every glyph into one buffer.  Each strip of n
+// vertices becomes n-1 line segments so that a glyph is drawn with a
+// single glDrawArrays( GL_LINES ).
+
+void StrokeFont::setupGlyphs()
+
+{
+  SFG_StrokeFont *font = &fgStrokeMonoRoman;
+
+  glyphFirst = new int[ font->Quantity ];
+  glyphCount = new int[ font->Quantity ];
+
+  // Count
+
+  int numVerts = 0;
+
+  for (int c=0; c<font->Quantity; c++) {
+
+    const SFG_StrokeChar *schar = font->Characters[c];
+
+    glyphFirst[c] = numVerts;
+    glyphCount[c] = 0;
+
+    if (schar != NULL)
+      for (int i=0; i<schar->Number; i++)
+	if (schar->Strips[i].Number > 1)
+	  glyphCount[c] += 2 * (schar->Strips[i].Number - 1);
+
+    numVerts += glyphCount[c];
+  }
+
+  // Fill
+
+  float *verts = new float[ numVerts*2 ];
+  int n = 0;
+
+  for (int c=0; c<font->Quantity; c++) {
+
+    const SFG_StrokeChar *schar = font->Characters[c];
+
+    if (schar != NULL)
+      for (int i=0; i<schar->Number; i++) {
+
+	const SFG_StrokeStrip *strip = &schar->Strips[i];
+
+	for (int j=1; j<strip->Number; j++) {
+	  verts[n++] = strip->Vertices[j-1].X;
+	  verts[n++] = strip->Vertices[j-1].Y;
+	  verts[n++] = strip->Vertices[j].X;
+	  verts[n++] = strip->Vertices[j].Y;
+	}
+      }
+  }
+
+  // Store in a VAO
+
+  glGenVertexArrays( 1, &VAO );
+  GPUProgram::bindVAO( VAO );
+
+  GLuint VBO;
+  glGenBuffers( 1, &VBO );
+  glBindBuffer( GL_ARRAY_BUFFER, VBO );
+  glBufferData( GL_ARRAY_BUFFER, numVerts*2*sizeof(float), verts, GL_STATIC_DRAW );
+
+  glEnableVertexAttribArray( 0 );
+  glVertexAttribPointer( 0, 2, GL_FLOAT, GL_FALSE, 0, 0 );
+
+  glBindBuffer( GL_ARRAY_BUFFER, 0 );
+  GPUProgram::bindVAO( 0 );
+
+  delete[] verts;
+}
+
+
+void StrokeFont::drawStrokeString( const string &str, float x, float y, float height, float theta, Alignment alignment )
 
 {
   gpuProg->activate();
@@ -68,9 +143,10 @@ void StrokeFont::drawStrokeString( string str, float x, float y, float height, f
   for (unsigned int k=0; k<str.size(); k++)
     if (str[k] == '\n')
       width = 0;
-    else {
+    else if ((unsigned char) str[k] < font->Quantity) {
       const SFG_StrokeChar *schar = font->Characters[ (unsigned char) str[k] ];
-      width += schar->Right;
+      if (schar != NULL)
+	width += schar->Right;
     }
 
   float xOffset;
@@ -83,6 +159,17 @@ void StrokeFont::drawStrokeString( string str, float x, float y, float height, f
     xOffset = -width; break;
   }
 
+  // The glyph-to-string transform is the same for every glyph
+
+  mat4 transform
+    = rotate( theta, vec3(0,0,1) )
+    * translate( s*xOffset, 0, 0 )
+    * scale( s, s, 1 );
+
+  gpuProg->setMat4( "MVP", transform );
+
+  GPUProgram::bindVAO( VAO );
+
   // Draw each letter
 
   float xPos = x;
@@ -97,64 +184,18 @@ void StrokeFont::drawStrokeString( string str, float x, float y, float height, f
 
     } else {
 
-      mat4 transform
-	= translate( xPos, y, 0 )
-	* rotate( theta, vec3(0,0,1) )
-	* translate( s*xOffset, 0, 0 )
-	* scale( s, s, 1 );
-
-      gpuProg->setMat4( "MVP", transform );
-
-      // glutStrokeCharacter( font, str[k] );
-      //
-      // The following is extracted from FreeGlut source.
-
-      const SFG_StrokeChar  *schar = font->Characters[ (unsigned char) str[k] ];
-      const SFG_StrokeStrip *strip = schar->Strips;
+      unsigned char c = str[k];
 
-      for (int i=0; i<schar->Number; i++, strip++) {
+      if (c >= font->Quantity || font->Characters[c] == NULL)
+	continue;
 
-	// Create a VAO for this stroke
+      gpuProg->setVec2( "glyphOrigin", vec2( xPos, y ) );
 
-	GLuint VAO;
-	glGenVertexArrays( 1, &VAO );
-	glBindVertexArray( VAO );
-
-	// Fill a buffer with the stroke's vertices
-
-	float *verts = new float[strip->Number*2];
-
-	for (int j=0; j<strip->Number; j++) {
-	  verts[j*2+0] = strip->Vertices[ j ].X;
-	  verts[j*2+1] = strip->Vertices[ j ].Y;
-	}
-
-	// Fill a VBO with the stroke's vertices
-
-	GLuint VBO;
-	glGenBuffers( 1, &VBO );
-	glBindBuffer( GL_ARRAY_BUFFER, VBO );
-	glBufferData( GL_ARRAY_BUFFER, strip->Number*2*sizeof(float), verts, GL_STATIC_DRAW );
-
-	delete[] verts;
-
-	// Draw the stroke
-
-	glEnableVertexAttribArray( 0 );
-	glVertexAttribPointer( 0, 2, GL_FLOAT, GL_FALSE, 0, 0 );
-
-	glDrawArrays( GL_LINE_STRIP, 0, strip->Number );
-
-	// Free everything
-
-	glDisableVertexAttribArray( 0 );
-	glDeleteBuffers( 1, &VBO );
-	glDeleteVertexArrays( 1, &VAO );
-      }
+      glDrawArrays( GL_LINES, glyphFirst[c], glyphCount[c] );
 
       // Move to next position
 
-      xPos += s * schar->Right;
+      xPos += s * font->Characters[c]->Right;
     }
 
   gpuProg->deactivate();
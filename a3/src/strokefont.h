@@ -20,14 +20,25 @@ class StrokeFont {
 
   GPUProgram *gpuProg;
 
+  // The whole font is packed into one vertex buffer when the
+  // StrokeFont is made.  Each glyph's strips are stored as GL_LINES
+  // at glyphFirst[c], with glyphCount[c] vertices.
+
+  GLuint VAO;
+  int   *glyphFirst;
+  int   *glyphCount;
+
+  void setupGlyphs();
+
  public:
 
   StrokeFont() {
     gpuProg = new GPUProgram();
     gpuProg->init( fontVertexShader, fontFragmentShader, "strokefont" );
+    setupGlyphs();
   }
 
-  void drawStrokeString( string str, float x, float y, float height, float theta, Alignment alignment );
+  void drawStrokeString( const string &str, float x, float y, float height, float theta, Alignment alignment );
 };
 
 
@@ -0,0 +1,120 @@
+// threadPool.cpp
+
+
+#include "threadPool.h"
+
+#include <cstddef>
+
+
+ThreadPool::ThreadPool( int numThreads )
+
+{
+  if (numThreads <= 0)
+    numThreads = std::thread::hardware_concurrency();
+
+  if (numThreads <= 0)  // (if the number of cores is unknown)
+    numThreads = 1;
+
+  this->numThreads = numThreads;
+
+  task     = NULL;
+  taskData = NULL;
+  numTasks = 0;
+  nextTask = 0;
+  numBusy  = 0;
+  job      = 0;
+  quit     = false;
+
+  workers = new std::thread[ numThreads-1 ];
+
+  for (int i=0; i<numThreads-1; i++)
+    workers[i] = std::thread( &ThreadPool::workerLoop, this );
+}
+
+
+ThreadPool::~ThreadPool()
+
+{
+  {
+    std::lock_guard<std::mutex> lock( mutex );
+    quit = true;
+  }
+
+  workReady.notify_all();
+
+  for (int i=0; i<numThreads-1; i++)
+    workers[i].join();
+
+  delete [] workers;
+}
+
+
+// Claim and run tasks until there are none left
+
+void ThreadPool::doTasks()
+
+{
+  int t;
+
+  while ((t = nextTask++) < numTasks)
+    task( taskData, t );
+}
+
+
+void ThreadPool::workerLoop()
+
+{
+  long lastJob = 0;
+
+  while (true) {
+
+    {
+      std::unique_lock<std::mutex> lock( mutex );
+      workReady.wait( lock, [&]{ return quit || job != lastJob; } );
+      if (quit)
+	return;
+      lastJob = job;
+    }
+
+    doTasks();
+
+    {
+      std::lock_guard<std::mutex> lock( mutex );
+      numBusy--;
+      if (numBusy == 0)
+	workDone.notify_one();
+    }
+  }
+}
+
+
+void ThreadPool::run( int numTasks, void (*task)( void *data, int taskIndex ), void *data )
+
+{
+  // Run small jobs directly
+
+  if (numThreads == 1 || numTasks <= 1) {
+    for (int t=0; t<numTasks; t++)
+      task( data, t );
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock( mutex );
+    this->task     = task;
+    this->taskData = data;
+    this->numTasks = numTasks;
+    nextTask = 0;
+    numBusy  = numThreads-1;
+    job++;
+  }
+
+  workReady.notify_all();
+
+  doTasks();
+
+  // Wait for the workers to finish their last tasks
+
+  std::unique_lock<std::mutex> lock( mutex );
+  workDone.wait( lock, [&]{ return numBusy == 0; } );
+}
@@ -0,0 +1,60 @@
+// threadPool.h
+//
+// A fixed pool of worker threads that run the tasks of a parallel
+// loop.
+//
+//   ThreadPool pool;              // one thread per core (or ThreadPool(n) for n threads)
+//
+//   pool.run( numTasks, task, data );
+//
+// calls task( data, t ) for t = 0 .. numTasks-1, spread over the
+// workers and the calling thread, and returns when all tasks are
+// done.  Tasks must not depend on the order in which they run.
+//
+// The workers are started once and wait between calls, so run() does
+// not create threads or allocate.
+
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+
+class ThreadPool {
+
+  int          numThreads;  // including the thread that calls run()
+  std::thread *workers;     // numThreads-1 of these
+
+  std::mutex              mutex;
+  std::condition_variable workReady;  // signalled when a job starts (or the pool is deleted)
+  std::condition_variable workDone;   // signalled when the last worker finishes a job
+
+  void (*task)( void *data, int taskIndex );
+  void  *taskData;
+  int    numTasks;
+
+  std::atomic<int> nextTask;  // next task to be claimed
+  int   numBusy;              // workers still working on the current job
+  long  job;                  // incremented at the start of each job
+  bool  quit;
+
+  void workerLoop();
+  void doTasks();
+
+ public:
+
+  ThreadPool( int numThreads = 0 );  // 0 means one thread per core
+  ~ThreadPool();
+
+  int size() {
+    return numThreads;
+  }
+
+  void run( int numTasks, void (*task)( void *data, int taskIndex ), void *data );
+};
+
+#endif
@@ -0,0 +1,261 @@
+// toi.cpp
+
+
+#include "toi.h"
+
+
+#define NUM_ROOT_SAMPLES    32  // subintervals searched for a sign change of a quartic
+#define NUM_ROOT_BISECTIONS 40
+
+#define MIN_APPROACH_SPEED  1e-6  // overlapping objects closing slower than this are not in contact ...
+#define APPROACH_ROUNDING   2e-6  // ... or than this fraction of their relative speed
+
+
+// Slowest closing speed that counts as approaching for objects with
+// relative velocity v.  A collision response computed in floats leaves
+// a closing speed of up to a few float roundings of |v|, which is no
+// approach at all.
+
+static double minApproachSpeed( vec3 v )
+
+{
+  return MIN_APPROACH_SPEED + APPROACH_ROUNDING * v.length();
+}
+
+
+// Earliest t in [0,tMax] at which c2 t^2 + c1 t + c0 falls to zero,
+// given c0 > 0 (or c0 = 0 and c2 < 0).
+
+static double quadraticFirstRoot( double c2, double c1, double c0, double tMax )
+
+{
+  if (c2 == 0) {
+    if (c1 >= 0)
+      return NO_CONTACT;
+    double t = -c0 / c1;
+    return (t <= tMax ? t : NO_CONTACT);
+  }
+
+  double disc = c1*c1 - 4*c2*c0;
+
+  if (disc < 0)
+    return NO_CONTACT;
+
+  // For c2 > 0 this is the smaller root.  For c2 < 0 the roots have
+  // opposite signs and this is the positive one.  Either way, it is
+  // where the polynomial goes from positive to negative.
+
+  double t = (-c1 - sqrt(disc)) / (2*c2);
+
+  return (t >= 0 && t <= tMax ? t : NO_CONTACT);
+}
+
+
+// Earliest t in [0,tMax] at which the quartic c[4] t^4 + ... + c[0]
+// falls to zero, given c[0] > 0 (or c[0] = 0 and rising at first).  The interval is sampled for a sign
+// change, which is then bisected.  A grazing contact that touches
+// zero between samples can be missed; it will show up as an overlap
+// at the start of a later interval.
+
+static double quarticFirstRoot( double c[5], double tMax )
+
+{
+  double t0 = 0;
+
+  for (int k=1; k<=NUM_ROOT_SAMPLES; k++) {
+
+    double t1 = tMax * k / (double) NUM_ROOT_SAMPLES;
+    double f1 = (((c[4]*t1 + c[3])*t1 + c[2])*t1 + c[1])*t1 + c[0];
+
+    if (f1 <= 0) {
+      for (int i=0; i<NUM_ROOT_BISECTIONS; i++) {
+	double tm = 0.5 * (t0 + t1);
+	double fm = (((c[4]*tm + c[3])*tm + c[2])*tm + c[1])*tm + c[0];
+	if (fm <= 0)
+	  t1 = tm;
+	else
+	  t0 = tm;
+      }
+      return t1;
+    }
+
+    t0 = t1;
+  }
+
+  return NO_CONTACT;
+}
+
+
+// Earliest t in [0,tMax] at which |p0 + p1 t + p2 t^2| falls to R.
+
+static double firstTouch( vec3 p0, vec3 p1, vec3 p2, float R, double tMax )
+
+{
+  double c[5];
+
+  c[0] = p0*p0 - (double) R*R;
+  c[1] = 2 * (p0*p1);
+  c[2] = p1*p1 + 2 * (p0*p2);
+  c[3] = 2 * (p1*p2);
+  c[4] = p2*p2;
+
+  // Already touching: a contact only if approaching.  (A tiny closing
+  // speed, as from an underflowed velocity or the rounding of the last
+  // response, would otherwise be resolved at t = 0 over and over
+  // without the simulation advancing.)
+
+  if (c[0] <= 0) {
+
+    if (c[1] < -2 * minApproachSpeed( p1 ) * p0.length())
+      return 0;
+
+    // Moving apart.  On a straight path it stays that way, but a
+    // curved path can turn back while still overlapping.  Then the
+    // contact is when it gets back to the current distance.
+
+    if (c[3] == 0 && c[4] == 0)
+      return NO_CONTACT;
+
+    c[0] = 0;
+  }
+
+  if (c[3] == 0 && c[4] == 0)
+    return quadraticFirstRoot( c[2], c[1], c[0], tMax );
+  else
+    return quarticFirstRoot( c, tMax );
+}
+
+
+
+// Sphere/sphere TOI.  Only the relative motion matters.
+
+float sphereSphereTOI( vec3 x1, vec3 v1, vec3 a1, float r1,
+		       vec3 x2, vec3 v2, vec3 a2, float r2, float tMax )
+
+{
+  vec3 p = x2 - x1;
+  vec3 v = v2 - v1;
+  vec3 h = 0.5 * (a2 - a1);
+
+  // Early out if the spheres cannot reach each other in tMax
+
+  float reach = v.length() * tMax + h.length() * tMax * tMax;
+
+  if (p.length() - (r1 + r2) > reach)
+    return NO_CONTACT;
+
+  return firstTouch( p, v, h, r1 + r2, tMax );
+}
+
+
+
+// Sphere/rectangle TOI.  The earliest of the contacts with the face,
+// the four edges, and the four corners.  'contactPoint' is set to the
+// point on the rectangle that is touched.
+
+float sphereRectangleTOI( vec3 x, vec3 v, vec3 a, float r, Rectangle &rectangle, float tMax, vec3 *contactPoint )
+
+{
+  // Rectangle frame: centre c, in-plane axes u and w, normal n, half extents hx and hy
+
+  const RectangleFrame &frame = rectangle.frame();
+
+  vec3 u = frame.xAxis;
+  vec3 w = frame.yAxis;
+  vec3 n = rectangle.normal;
+  vec3 c = rectangle.centre;
+
+  float hx = frame.halfX;
+  float hy = frame.halfY;
+
+  vec3 p = x - c;
+  vec3 h = 0.5 * a;
+
+  // Early out if the sphere cannot reach the rectangle in tMax
+
+  float dx = fabs(p*u) - hx;
+  float dy = fabs(p*w) - hy;
+  float dz = p*n;
+
+  if (dx < 0) dx = 0;
+  if (dy < 0) dy = 0;
+
+  float reach = v.length() * tMax + h.length() * tMax * tMax;
+
+  if (sqrt( dx*dx + dy*dy + dz*dz ) - r > reach)
+    return NO_CONTACT;
+
+  double tMin = NO_CONTACT;
+  double tEnd = tMax;  // only look for contacts earlier than the earliest so far
+
+  // Face: the signed distance from the plane, on the side of the sphere centre, falls to r
+
+  float side = (dz >= 0 ? 1 : -1);
+
+  double d0 = side * dz - r;
+  double d1 = side * (v*n);
+  double d2 = side * (h*n);
+
+  double t;
+
+  if (d0 > 0)
+    t = quadraticFirstRoot( d2, d1, d0, tMax );
+  else if (d1 < -minApproachSpeed( v ))
+    t = 0;
+  else if (d2 < 0)  // overlapping and moving apart, but turning back (as in firstTouch())
+    t = quadraticFirstRoot( d2, d1, 0, tMax );
+  else
+    t = NO_CONTACT;
+
+  if (t != NO_CONTACT) {
+    vec3 pt = p + t * v + (t*t) * h;
+    float px = pt*u;
+    float py = pt*w;
+    if (fabs(px) <= hx && fabs(py) <= hy) {
+      tMin = tEnd = t;
+      *contactPoint = c + px * u + py * w;
+    }
+  }
+
+  // Edges and corners
+
+  vec3 corners[4] = { c - hx*u - hy*w,
+		      c + hx*u - hy*w,
+		      c + hx*u + hy*w,
+		      c - hx*u + hy*w };
+
+  for (int i=0; i<4; i++) {
+
+    vec3 tail = corners[i];
+    vec3 head = corners[(i+1)%4];
+
+    float len = (head - tail).length();
+    vec3  e   = (1.0/len) * (head - tail);
+
+    // Edge: distance from the edge's line, i.e. the path with its
+    // component along the edge removed
+
+    vec3 q = x - tail;
+
+    t = firstTouch( q - (q*e)*e, v - (v*e)*e, h - (h*e)*e, r, tEnd );
+
+    if (t < tMin) {
+      float s = (q + t * v + (t*t) * h) * e;
+      if (s >= 0 && s <= len) {
+	tMin = tEnd = t;
+	*contactPoint = tail + s * e;
+      }
+    }
+
+    // Corner
+
+    t = firstTouch( q, v, h, r, tEnd );
+
+    if (t < tMin) {
+      tMin = tEnd = t;
+      *contactPoint = tail;
+    }
+  }
+
+  return tMin;
+}
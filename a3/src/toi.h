@@ -0,0 +1,38 @@
+// toi.h
+//
+// Analytic time of impact (TOI).
+//
+// Over an interval, each sphere centre follows the path
+//
+//    x(t) = x + v t + 1/2 a t^2
+//
+// for constant 'a' (a = 0 for the straight-line path of an explicit
+// Euler step).  The functions below return the earliest time in
+// [0,tMax] at which a sphere first touches another object while
+// approaching it, or NO_CONTACT if there is no such time.  A sphere
+// that already overlaps the object and is approaching it returns 0.
+// One that overlaps it and is moving apart along a path that turns
+// back returns the time at which it is back at the same distance.
+//
+// With a = 0, or with the same 'a' for both spheres in a pair, all of
+// the contact times are roots of quadratics and are solved in closed
+// form.  Otherwise the contact time is a root of a quartic and is
+// found numerically.
+
+
+#ifndef TOI_H
+#define TOI_H
+
+#include "linalg.h"
+#include "rectangle.h"
+
+
+#define NO_CONTACT FLT_MAX
+
+
+float sphereSphereTOI( vec3 x1, vec3 v1, vec3 a1, float r1,
+		       vec3 x2, vec3 v2, vec3 a2, float r2, float tMax );
+
+float sphereRectangleTOI( vec3 x, vec3 v, vec3 a, float r, Rectangle &rectangle, float tMax, vec3 *contactPoint );
+
+#endif
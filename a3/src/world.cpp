@@ -2,6 +2,9 @@
 
 #include "world.h"
 #include "main.h"
+#include "toi.h"
+#include "simd.h"
+#include "sphereRenderer.h"
 #include <cstdlib>
 #include <iostream>
 #include <fstream>
@@ -33,12 +36,31 @@
 #define MIN_NORMAL_DISTANCE 0.05 // distance below which a sphere comes to rest perp to the plane (can still have parallel motion)
 #define MIN_NORMAL_SPEED 0.05     // speed below which a sphere comes to rest
 
-#define MAX_TIME_STEP 0.001 // max time of one integration step
+#define ZENO_REST_TIME 0.2 // total time of the remaining bounces below which a bouncing sphere comes to rest
+
+#define MAX_TIME_STEP 0.001 // default time of one integration step
+
+#define MIN_ADAPTIVE_STEP 0.0005 // default bounds on the time steps chosen by safeTimeStep()
+#define MAX_ADAPTIVE_STEP 0.02
+
+#define MAX_STALLED_CONTACTS 100  // per sphere: contacts resolved without advancing before an adaptive step or an island's step is given up
+
+#define MAX_STEPS_PER_FRAME 100 // default cap on the steps taken by one call of updateState()
+
+#define MAX_CONTACT_SWEEPS 10 // most sweeps through the contacts in resolveContacts()
+
+#define MAX_EVENTS_PER_SPHERE 100 // most collisions per sphere in one call of simulateEvents()
+#define MAX_EVENT_MOVE        0.25 // most that a sphere moves in one call of simulateEvents(), in grid cells
 
 #define RECTANGLE_EDGE_BUFFER 0.03 // distance beyond rectangle edge after which to release constrained sphere
 
 #define MIN_SPHERE_Z -5 // height below which sphere is removed
 
+#define MIN_SPHERES_PER_CHUNK 256 // fewest spheres for which findCollisions() uses another thread
+
+#define SLEEP_SPEED   0.01 // speed below which a sphere resting on a rectangle goes to sleep
+#define WAKE_DISTANCE 0.1  // distance within which an approaching object wakes a sleeping sphere
+
 #define W2(x) std::setw(2)<<std::setfill('0')<<std::fixed<<(x)
 
 
@@ -72,6 +94,40 @@ const RectangleDef World::initRectangles[] = {
 World::World( char *sphereFilename ) 
 
 {
+  numSteps = 0;
+  numCollisions = 0;
+  broadphase = UNIFORM_GRID;
+  collisionTime = BISECTION;
+  allowSleeping = true;
+  restZenoBounces = true;
+  separateRestingContacts = true;
+  batchContacts = false;
+  sweptCollisions = false;
+  localRewind = false;
+  numAsleep = 0;
+
+  timeStep = MAX_TIME_STEP;
+  adaptiveTimeStep = false;
+  minAdaptiveStep = MIN_ADAPTIVE_STEP;
+  maxAdaptiveStep = MAX_ADAPTIVE_STEP;
+  closestGap = 0;
+  maxStepsPerFrame = MAX_STEPS_PER_FRAME;
+  overBudgetFrames = 0;
+  droppedTime = 0;
+  chosenDeltaT = 0;
+  unsimulatedTime = 0;
+
+  pool = NULL;
+  chunks = NULL;
+  islands = NULL;
+  numChunks = 0;
+  sphereRenderer = NULL;
+  closestSegs = NULL;
+  closestSegsCapacity = 0;
+  setNumThreads( 0 );
+
+  integrator = newIntegrator( EXPLICIT_EULER );
+
   // Add the rectangles defined above in 'initRectangles'
   
   for (int i=0; i<NUM_RECTANGLES; i++)
@@ -92,14 +148,12 @@ World::World( char *sphereFilename )
     vec3 centre;
 
     while (in >> radius >> centre)
-      spheres.add( Sphere( SPHERE_LEVELS, 
-			   radius,
-			   centre,
-			   ZERO_ORIENTATION,
-			   ZERO_VELOCITY,
-			   ZERO_ANG_VELOCITY ) );
+      addSphere( radius, centre );
 
     cout << "Read " << spheres.size() << " spheres from " << sphereFilename << endl;
+
+    initSphereState();
+    setGridCellSize();
     return;
   }
 
@@ -149,423 +203,2454 @@ World::World( char *sphereFilename )
       sphereCentres[numSpheres] = centre;
       numSpheres++;
 
-      spheres.add( Sphere( SPHERE_LEVELS, 
-			   radius,
-			   centre,
-			   ZERO_ORIENTATION,
-			   ZERO_VELOCITY,
-			   ZERO_ANG_VELOCITY ) );
+      addSphere( radius, centre );
     }
   }
 
   if (numSpheres < NUM_SPHERES_TO_GEN) 
     cout << "Only generated " << numSpheres << " spheres instead of the desired " << NUM_SPHERES_TO_GEN << ", likely due to crowding the the generation volume." << endl;
 
+  initSphereState();
+
   // Record this last set of sphere in case we want to debug with
   // the same spheres that were randomly generated.
 
-  ofstream out( "../tests/lastSpheres.txt" );
+  writeSpheres( "../tests/lastSpheres.txt" );
 
-  for (int i=0; i<numSpheres; i++)
-    out << spheres[i].radius << " " << spheres[i].state.x << endl;
+  setGridCellSize();
 }
 
 
 
-// Integrate
-//
-// Given the state at yStart, integrate over time deltaT to get state yEnd.
-//
-// Update the sphere states to yEnd.  Then call 'findCollisions' to
-// set collisionAtEnd, collisionSphere, and collisionObject.
-
+// Write the spheres in the same format as is read by the constructor
 
-void World::integrate( State *yStart, State *yEnd, float deltaT, bool &collisionAtEnd, Sphere **collisionSphere, Object **collisionObject )
+void World::writeSpheres( const char *filename )
 
 {
-  int nSpheres = spheres.size();
+  ofstream out( filename );
 
-  State *y      = new State[ nSpheres ];
-  State *yDeriv = new State[ nSpheres ];
+  for (int i=0; i<spheres.size(); i++)
+    out << sphereState.radius[i] << " " << sphereState.position(i) << endl;
+}
 
-  // For each state in 'yStart', copy it to 'y' and set 'yDeriv'
-  // appropriately.  Use GRAVITY_ACCEL as the velocity derivative.
-  // Set the angular velocity derivative to zero.
 
-  // [YOUR CODE HERE]
-  for (int i = 0; i < nSpheres; i++) {
-    y[i] = yStart[i];           // Copy initial state
-    yDeriv[i].x = yStart[i].v;  // dx/dt = velocity
-    yDeriv[i].v = GRAVITY_ACCEL; // dv/dt = acceleration (gravity)
-    yDeriv[i].q = quaternion(0, vec3(0,0,0));  // No angular velocity change
-    yDeriv[i].w = vec3(0, 0, 0); // No angular acceleration
-  }
-  // Integrate: Compute yEnd = yStart + deltaT * yDeriv
-  //
-  // Do this on the individual floats in 'y' and 'yDeriv'.  Do not
-  // refer to the sphere states here.
 
-  // [YOUR CODE HERE]
-  for (int i = 0; i < nSpheres; i++) {
-    yEnd[i].x = yStart[i].x + deltaT * yDeriv[i].x;  // Update position
-    yEnd[i].v = yStart[i].v + deltaT * yDeriv[i].v;  // Update velocity
-    yEnd[i].q = yStart[i].q;// *quaternion(1, 0.5f * deltaT * yDeriv[i].w);  // Update orientation
-    yEnd[i].w = yStart[i].w + deltaT * yDeriv[i].w;  // Update angular velocity
-  }
-  // Copy yEnd state into sphere states
+// Kinetic plus gravitational potential energy of the spheres.  The
+// spheres do not spin, so this is all of it.
 
+float World::totalEnergy()
 
-  //copyState( &spheres[0], yEnd );  // [----- DELETE THIS LINE !!!!  DO NOT ADD CODE HERE. -----]
+{
+  double energy = 0;
 
+  for (int i=0; i<spheres.size(); i++) {
+    vec3 v = sphereState.velocity(i);
+    energy += spheres[i].mass() * (0.5 * (v * v) - GRAVITY_ACCEL * sphereState.position(i));
+  }
 
-  copyState( yEnd, &spheres[0] );
+  return energy;
+}
 
-  // Check for collisions
 
-  collisionAtEnd = findCollisions( collisionSphere, collisionObject );
 
-  // Clean up
-  
-  delete [] y;
-  delete [] yDeriv;
-}
+World::~World()
+
+{
+  delete pool;
+  delete [] chunks;
+  delete [] islands;
+  delete integrator;
 
+#ifndef HEADLESS
+  delete sphereRenderer;
+#endif
+  delete [] closestSegs;
+}
 
 
-// Update the world state
-//
-// Move in integration steps of at most 'maxTimeStep'
 
+// Integrate with the given method from now on
 
-void World::updateState( float elapsedTime )
+void World::setIntegrator( IntegratorType type )
 
 {
-  float simulatedElapsedTime = timeFactor * elapsedTime;
-  
-  float actualDeltaT = 0;
-  
-  // Go in steps of MAX_TIME_STEP until deltaT
-  
-  while (actualDeltaT <  simulatedElapsedTime - MAX_TIME_STEP)
-    actualDeltaT += updateStateByDeltaT( MAX_TIME_STEP ); // might advance less than MAX_TIME_STEP
+  delete integrator;
+  integrator = newIntegrator( type );
+}
 
-  while (actualDeltaT < simulatedElapsedTime)
-    actualDeltaT += updateStateByDeltaT( simulatedElapsedTime - actualDeltaT );
 
-  // Remove any spheres that have fallen far off the base
 
-  for (int i=0; i<spheres.size(); i++)
-    if (spheres[i].state.x.z < MIN_SPHERE_Z) {
-      spheres.remove(i);
-      i--;
-    }
+// Use n threads for collision detection, or one per core if n is 0
+
+void World::setNumThreads( int n )
+
+{
+  delete pool;
+  delete [] chunks;
+  delete [] islands;
+
+  pool = new ThreadPool( n );
+  chunks = new CollisionChunk[ pool->size() ];
+  islands = new SphereIsland[ pool->size() ];
 }
 
 
 
-// Advance the state by time deltaT, or to the first collision that
-// occurs.  If a collision occurs, resolve it and set the state to the
-// time just before the collision.
+// Add a sphere at rest, with a handle slot
 
-float World::updateStateByDeltaT( float deltaT )
+void World::addSphere( float radius, vec3 centre )
 
 {
-  if (spheres.size() == 0)
-    return deltaT;
-
-  // For spheres constrained to be rolling on rectangles, set the
-  // sphere velocity normal to the rectangle to be zero.  Also ensure
-  // that the sphere touches the rectangle and a single point.
-  //
-  // Also: Remove the constraint when the sphere moves off the
-  // rectangle.
-  //
-  // This is not very realistic, as there's no rolling.
-  
-  for (int i=0; i<spheres.size(); i++) {
-    Sphere &s = spheres[i];
-    for (int j=0; j<spheres[i].constraintRectangles.size(); j++) {
-      Rectangle &r = *(spheres[i].constraintRectangles[j]);
+  spheres.emplace( radius,
+		   centre,
+		   ZERO_ORIENTATION,
+		   ZERO_VELOCITY,
+		   ZERO_ANG_VELOCITY );
 
-      // Check for constraint removal
+  sphereSlots.add();
+}
 
-      vec3 sphereCentre = (r.OCS_to_WCS().inverse() * vec4( s.state.x, 1.0 )).toVec3(); // now in coordinate system of rectangle
 
-      if (fabs(sphereCentre.x) > r.xDim/2.0+RECTANGLE_EDGE_BUFFER ||
-	  fabs(sphereCentre.y) > r.yDim/2.0+RECTANGLE_EDGE_BUFFER) {
+// Copy the spheres' initial state into 'sphereState', which holds the
+// state from then on.
 
-	spheres[i].constraintRectangles.remove(j);
-#if 0
-	cout << "Removed s" << W2(i) << "-r" << W2(j) << " constraint" << endl;
-#endif
-	j--;
-	continue;
-      }
+void World::initSphereState()
 
-      // Set position and velocity
-      
-      vec3 &n = r.normal;  // normal
-      vec3 &v = s.state.v; // velocity
-      vec3 &x = s.state.x; // position
+{
+  sphereState.resize( spheres.size() );
 
-      v = v - (v*n)*n;  // Set normal velocity to zero
-      x = x - ((x - r.centre)*n - s.radius)*n;  // Set normal position one sphere radius from rectangle
-    }
+  for (int i=0; i<spheres.size(); i++) {
+    sphereState.setPosition( i, spheres[i].state.x );
+    sphereState.setVelocity( i, spheres[i].state.v );
+    sphereState.radius[i] = spheres[i].radius;
+    sphereState.flags[i]  = (spheres[i].constraintRectangles.size() > 0 ? SPHERE_CONSTRAINED : 0);
   }
 
-  // Collect start state
+  copyState( sphereState, prevState );
+}
 
-  State *yStart = new State[ spheres.size() ];
-  State *yEnd   = new State[ spheres.size() ];
 
-  copyState( &spheres[0], yStart );  // copy sphere states into state vector 'yStart'
 
-  // Integrate
-  
-  bool collisionAtEnd;
-  Sphere *collisionSphere = NULL;
-  Object *collisionObject = NULL;
+// Copy positions and velocities from 'sphereState' to the Sphere
+// objects, which are drawn from their 'state'.  Positions are
+// interpolated by 'alpha' from 'prevState' to 'sphereState', so that
+// drawing is smooth although the state only changes in whole steps.
 
-  float actualDeltaT;
+void World::copyStateToSpheres( float alpha )
 
-  integrate( yStart, yEnd, deltaT, collisionAtEnd, &collisionSphere, &collisionObject );
+{
+  for (int i=0; i<spheres.size(); i++) {
+    vec3 x0 = prevState.position(i);
+    spheres[i].state.x = x0 + alpha * (sphereState.position(i) - x0);
+    spheres[i].state.v = sphereState.velocity(i);
+  }
+}
 
-  if (!collisionAtEnd) {
 
-    // no collisions in this integration step.  We're done.
 
-    actualDeltaT = deltaT;
-    copyState( yEnd, &spheres[0] );  // update sphere states and return
+// Set the broadphase cell size to a sphere diameter, which is
+// MAX_SPHERE_RADIUS unless a sphere file contains larger spheres.
+// Spheres can then only touch if they are in adjacent grid cells.
 
-  } else {
+void World::setGridCellSize()
 
-    // a collision: Do binary seach until interval is at most
-    // MIN_DELTA_T_FOR_COLLISIONS.
-    //
-    // Once your search is complete, 'yStart' should contain the state
-    // at the start of the interval and 'yEnd' should contain the
-    // state at the end of the interval.  Call integrate() as
-    // necessary to get the end state from a given start state.
-    //
-    // Once the search is complete, 'actualDeltaT' should be the time
-    // to the start of the interval.  actualDeltaT is in (0,deltaT)
-    // and is the amount of time the simulation advances before the
-    // collision is arrived at.
-    //
-    // Read the code above to see how it can be determined that no
-    // collisions occur in an interval.
-    
-    actualDeltaT = 0;
+{
+  float maxRadius = MAX_SPHERE_RADIUS;
 
+  for (int i=0; i<spheres.size(); i++)
+    if (spheres[i].radius > maxRadius)
+      maxRadius = spheres[i].radius;
 
-    // [YOUR CODE HERE]
-    float lower = 0, upper = deltaT, mid;
-    while (upper - lower > MIN_DELTA_T_FOR_COLLISIONS) {
-      mid = (lower + upper) / 2.0f;
-      integrate(yStart, yEnd, mid, collisionAtEnd, &collisionSphere, &collisionObject);
-      if (collisionAtEnd)
-        upper = mid;
-      else {
-        lower = mid;
-        copyState(yEnd, yStart);
-      }
-    }
-    actualDeltaT = lower;
+  gridCellSize = 2 * maxRadius;
+}
 
-    // Set the sphere states to that at the START of the interval so
-    // that collision has not yet occurred.  Since the objects DO NOT
-    // MOVE during collision resolution, this ensures that the objects
-    // are not in collision immediately after the collision is
-    // resolved.  (In the contrary case, a new collision would be
-    // immediately detected, causing the simulation to stop advancing.)
 
-    copyState( yStart, &spheres[0] );
 
-    // Resolve the collision
+// Integrate
+//
+// Given the state at yStart, integrate over time deltaT to get state yEnd.
+//
+// Update the sphere states to yEnd.  Then call 'findCollisions' to
+// set collisionAtEnd, collisionSphere, and collisionObject.
+//
+// findCollisions() only sees objects that overlap at the end, so a
+// sphere that moves more than its diameter in a step can pass through
+// a rectangle or another sphere unseen.  With 'sweptCollisions', the
+// spheres' paths from yStart over deltaT are also searched with
+// findFirstContact(), and a contact anywhere along them counts as a
+// collision at the end.  This is still true for any longer deltaT, so
+// the binary search in updateStateByDeltaT() closes in on the contact
+// as before.
 
-    resolveCollision( collisionSphere, collisionObject );
 
-    // Debugging: report collision
+void World::integrate( SphereStateArrays &yStart, SphereStateArrays &yEnd, float deltaT, bool &collisionAtEnd, Sphere **collisionSphere, Object **collisionObject )
 
-#if 0
-    bool otherIsSphere = (dynamic_cast<Sphere*>( collisionObject ) != NULL);
-    cout << "collision s" << W2(collisionSphere - &spheres[0]) << "-";
-    if (otherIsSphere) {
-      Sphere *s = dynamic_cast<Sphere*>( collisionObject );
-      cout << "s" << W2(s - &spheres[0])
-	   << ", relative speed " << (collisionSphere->state.v - s->state.v) * (collisionSphere->state.x - s->state.x).normalize()
-	   << ", relative position " << (collisionSphere->state.x - s->state.x) * (collisionSphere->state.x - s->state.x).normalize()
-	   << endl;
-    } else {
-      Rectangle *r = dynamic_cast<Rectangle*>( collisionObject );
-      cout << "r" << W2(r - &rectangles[0])
-	   << ", relative speed " << collisionSphere->state.v * r->normal
-	   << ", relative position " << (collisionSphere->state.x - r->centre) * r->normal << endl;
-    }
-#endif
+{
+  float   tSwept = NO_CONTACT;
+  Sphere *sweptSphere = NULL;
+  Object *sweptObject = NULL;
 
+  if (sweptCollisions && !localRewind) {  // (islands are not swept)
+    copyState( yStart, sphereState );
+    tSwept = findFirstContact( deltaT, &sweptSphere, &sweptObject );
   }
 
-  // Clean up
+  advance( yStart, yEnd, deltaT );
 
-  delete [] yStart;
-  delete [] yEnd;
+  // Check for collisions
 
-  return actualDeltaT;
-}
+  collisionAtEnd = findCollisions( collisionSphere, collisionObject );
 
+  if (!collisionAtEnd && tSwept != NO_CONTACT) {
 
+    collisionAtEnd = true;
+    *collisionSphere = sweptSphere;
+    *collisionObject = sweptObject;
 
-// If there was a collision over time deltaT, use binary search to
-// find the time of collision (to within MIN_DELTA_T_FOR_COLLISIONS)
-// and set yEnd to the state just BEFORE that collision.
-//
+    if (batchContacts) {  // the contact is not in 'contacts'
+      Sphere *otherSphere = dynamic_cast<Sphere*>( sweptObject );
+      contacts.clear();
+      if (otherSphere != NULL)
+	contacts.add( sphereIndex( sweptSphere ), sphereIndex( otherSphere ), true );
+      else
+	contacts.add( sphereIndex( sweptSphere ), dynamic_cast<Rectangle*>( sweptObject ) - &rectangles[0], false );
+    }
+  }
+}
 
 
-bool World::findCollisions( Sphere **collisionSphere, Object **collisionObject )
 
-{
-  int nSpheres = spheres.size();
+// Given the state at yStart, integrate over time deltaT to get state
+// yEnd, and update the sphere states to yEnd.
 
-  // Reset min distances on each sphere (used for drawing lines to closest object)
-  
-  for (int i=0; i<nSpheres; i++)
-    spheres[i].minDist = FLT_MAX;
+void World::advance( SphereStateArrays &yStart, SphereStateArrays &yEnd, float deltaT )
 
-  // Check for sphere/sphere collisions
+{
+  int nSpheres = yStart.n;
 
-  float minDist = FLT_MAX;
+  yEnd.resize( nSpheres );
 
-  for (int i=0; i<nSpheres; i++)
-    for (int j=0; j<nSpheres; j++) 
-      if (i != j) {
+  // The derivative of the state is dx/dt = v and dv/dt =
+  // GRAVITY_ACCEL.  (Orientation and angular velocity do not change
+  // and are not part of the physics state.)
+  //
+  // Integrate with the chosen integrator, which works on the
+  // individual floats, one component array at a time.  Do not refer
+  // to the sphere states here.
+
+  integrator->step( yStart, yEnd, deltaT, GRAVITY_ACCEL );
+
+  // Sleeping spheres do not move.  They are integrated with the
+  // others, as the integrators run over whole component arrays, and
+  // then put back.  (Gathering the awake spheres into arrays of their
+  // own would cost about as much as integrating all of them.)
+
+  if (numAsleep > 0)
+    for (int i=0; i<nSpheres; i++)
+      if (sphereState.flags[i] & SPHERE_ASLEEP) {
+	yEnd.setPosition( i, yStart.position(i) );
+	yEnd.setVelocity( i, yStart.velocity(i) );
+      }
 
-	vec3 centreToCentre = spheres[j].state.x - spheres[i].state.x;
-	float dist = centreToCentre.length() - spheres[i].radius - spheres[j].radius;
+  // Copy yEnd state into sphere states
 
-	float relativeVelocitySign = (spheres[j].state.v - spheres[i].state.v) * centreToCentre;
+  copyState( yEnd, sphereState );
+}
 
-	if (relativeVelocitySign < 0) { // < 0 if coming together, > 0 is moving apart
 
-	  if (dist < minDist) {
-	    minDist = dist;
-	    *collisionSphere = &spheres[i];
-	    *collisionObject = &spheres[j];
-	  }
 
-	  if (dist < spheres[i].minDist) {
-	    spheres[i].minDist = dist;
-	    spheres[i].contactPoint = spheres[i].state.x + 0.5 * centreToCentre;
-	  }
-	}
-      }
+// Update the world state
+//
+// Advance the simulated time by timeFactor * elapsedTime, in steps of
+// 'timeStep' or, if 'adaptiveTimeStep' is set or the simulation is
+// EVENT_DRIVEN, in steps chosen by safeTimeStep().
 
-  // Check for sphere/rectangle collisions
-  //
-  // However, do not check against rectangles that a sphere is constrained to remain in contact with.
 
-  for (int i=0; i<nSpheres; i++)
-    for (int j=0; j<rectangles.size(); j++) 
-      if (! spheres[i].constraintRectangles.exists( &rectangles[j] )) { // skip constraining rectangles
+void World::updateState( float elapsedTime )
 
-	vec3 contactPoint;
-	float dist = spheres[i].distToRectangle( rectangles[j], &contactPoint );
+{
+  unsimulatedTime += timeFactor * elapsedTime;
 
-	float relativeVelocitySign = (((spheres[i].state.x - rectangles[j].centre) * rectangles[j].normal) * rectangles[j].normal) * spheres[i].state.v;
+  if (adaptiveTimeStep || collisionTime == EVENT_DRIVEN)
+    takeAdaptiveSteps();
+  else
+    takeFixedSteps();
 
-	if (relativeVelocitySign < 0) { // < 0 if coming together, > 0 is moving apart
+  // Remove any spheres that have fallen far off the base
 
-	  if (dist < minDist) {
-	    minDist = dist;
-	    *collisionSphere = &spheres[i];
-	    *collisionObject = &rectangles[j];
-	  }
+  removeFallenSpheres();
 
-	  if (dist < spheres[i].minDist) {
-	    spheres[i].minDist = dist;
-	    spheres[i].contactPoint = contactPoint;
-	  }
-	}
-      }
+  // Draw the state 'unsimulatedTime' after the start of the last step
 
-  return (minDist <= 0);
+  copyStateToSpheres( unsimulatedTime / timeStep );
 }
 
 
 
-// Resolve a collision between a sphere and another object.  The other
-// object can be a sphere or a rectangle.  Rectangles are immovable.
+// Remove the spheres that have fallen below MIN_SPHERE_Z.  The
+// others are compacted in one pass, keeping their order, so this
+// costs O(n) however many spheres fell, rather than O(n) for each.
 
-void World::resolveCollision( Sphere *sphere, Object *otherObject )
+void World::removeFallenSpheres()
 
 {
-  // Extract the collision object as a sphere or rectangle
-  
-  bool otherIsSphere = (dynamic_cast<Sphere*>(otherObject) != NULL);
+  int n = 0;
 
-  if (otherIsSphere) {
+  for (int i=0; i<spheres.size(); i++)
+    if (sphereState.z[i] < MIN_SPHERE_Z) {
+      if (sphereState.flags[i] & SPHERE_ASLEEP)
+	numAsleep--;
+      sphereSlots.release( i );
+    } else {
+      if (n != i)
+	moveSphere( i, n );
+      n++;
+    }
 
-    // SPHERE/SPHERE COLLISION
+  if (n < spheres.size())
+    truncateSpheres( n );
+}
 
-    Sphere *sphere2 = dynamic_cast<Sphere*>(otherObject);
 
-    // [YOUR CODE HERE: REPLACE THE CODE BELOW]
-    
-    // Find a normal to the tangent plane between the spheres
+// Remove one sphere in O(1) by moving the last sphere into its place
 
-    vec3 n = (sphere->state.x - sphere2->state.x).normalize();
+void World::removeSphere( SphereHandle h )
 
-    // Find the velocity in the normal direction after the collisions
+{
+  int i = sphereSlots.index( h );
 
-    float v1b = sphere->state.v * n; // sphere 1 velocity before in normal direction
-    float v2b = sphere2->state.v * n; // sphere 2 velocity before in normal direction
+  if (i < 0)
+    return;
 
-    float m1 = sphere->mass();  // sphere 1 mass
-    float m2 = sphere2->mass();  // sphere 2 mass
-  
-    float v1a = (m1 * v1b + m2 * v2b + COEFF_OF_RESTITUTION * m2 * (v2b - v1b)) / (m1 + m2); // sphere 1 velocity AFTER in normal direction
-    float v2a = (m1 * v1b + m2 * v2b + COEFF_OF_RESTITUTION * m1 * (v1b - v2b)) / (m1 + m2); // sphere 2 velocity AFTER in normal direction
+  if (sphereState.flags[i] & SPHERE_ASLEEP)
+    numAsleep--;
 
-    // Update sphere velocities in their respective 'state.v'
-    vec3 v1_tangent = sphere->state.v - (v1b * n);  // sphere 1 tangential velocity
-    vec3 v2_tangent = sphere2->state.v - (v2b * n); // sphere 2 tangential velocity
-    sphere->state.v  = v1_tangent + (v1a * n);  // sphere 1 velocity AFTER
-    sphere2->state.v = v2_tangent + (v2a * n);  // sphere 2 velocity AFTER
+  sphereSlots.release( i );
 
-    // [END OF YOUR CODE ABOVE]
+  int last = spheres.size()-1;
 
-  } else {
+  if (i != last)
+    moveSphere( last, i );
 
-    // SPHERE/RECTANGLE COLLISION
+  truncateSpheres( last );
+}
 
-    Rectangle *rectangle = dynamic_cast<Rectangle*>(otherObject);
 
-    // [YOUR CODE HERE: REPLACE THE CODE BELOW]
-    
-    // Find tangent plane normal
-    //
-    // Be careful to consider when the sphere hits the edge or corner
-    // of the rectangle, as the plane in these cases is NOT the plane
-    // of the rectangle.
+// Select the sphere after the selected one, or the first if none is
+// selected (or the selected one has been removed)
 
-    vec3 n = rectangle->normal;;
-    
-    // Find the velocity in the normal direction after the collisions
+void World::selectNextSphere()
 
-    float v1b = sphere->state.v * n; // sphere velocity before in normal direction
-    float v2b = 0; // rectangle velocity before in normal direction
+{
+  if (spheres.size() == 0)
+    return;
 
-    float m1 = sphere->mass();  // sphere mass
+  int i = sphereSlots.index( selectedSphere );
 
-    float m2 = 1e6;  // rectangle mass.  NOTE THAT THIS MASS IS VERY
-		      // LARGE AND CAN BE USED AS IF THE RECTANGLE IS
-		      // A MOVING OBJECT.  DO THIS!  See rectangle.h
-  
+  selectedSphere = sphereSlots.handle( (i+1) % spheres.size() );
+}
+
+
+// Move sphere 'from' over sphere 'to', which has been released
+
+void World::moveSphere( int from, int to )
+
+{
+  spheres[to] = std::move( spheres[from] );
+  sphereState.move( from, to );
+  prevState.move( from, to );
+  sphereSlots.move( from, to );
+}
+
+
+void World::truncateSpheres( int n )
+
+{
+  while (spheres.size() > n)
+    spheres.remove();
+
+  sphereState.resize( n );
+  prevState.resize( n );
+  sphereSlots.resize( n );
+}
+
+
+
+void World::takeFixedSteps()
+
+{
+  // Take whole steps of 'timeStep', at most 'maxStepsPerFrame' of
+  // them.  If the simulation has fallen further behind than that, the
+  // extra time is dropped (so the simulation slows down) rather than
+  // carried over to make the next frame take even longer.
+
+  int nSteps = (int) (unsimulatedTime / timeStep);
+
+  if (nSteps > maxStepsPerFrame) {
+    unsimulatedTime -= (nSteps - maxStepsPerFrame) * timeStep;
+    droppedTime += (nSteps - maxStepsPerFrame) * timeStep;
+    nSteps = maxStepsPerFrame;
+    overBudgetFrames++;
+  }
+
+  for (int s=0; s<nSteps; s++) {
+
+    if (s == nSteps-1)
+      copyState( sphereState, prevState ); // start of the last step, for drawing
+
+    float actualDeltaT = 0;
+
+    while (actualDeltaT < timeStep)
+      actualDeltaT += updateStateByDeltaT( timeStep - actualDeltaT ); // might advance less than asked
+
+    unsimulatedTime -= timeStep;
+  }
+
+  if (unsimulatedTime < 0)
+    unsimulatedTime = 0;
+}
+
+
+
+// Let updateStateByDeltaT() choose the steps, and go all the way to
+// the end of the frame, so that the state is drawn as is.  Again, at
+// most 'maxStepsPerFrame' steps are taken.  As with fixed steps, a
+// step is one that updateStateByDeltaT() chose: when a collision cuts
+// it short, the rest of it is taken without counting another step.
+//
+// Contacts resolved at the start of a sub-step advance no time.  A
+// settling pile can take a thousand of those in a row, but a contact
+// that the response cannot clear would recur forever, so after
+// MAX_STALLED_CONTACTS per sphere the rest of the step is given up.
+
+void World::takeAdaptiveSteps()
+
+{
+  int nSteps = 0;
+
+  while (unsimulatedTime > 0 && nSteps < maxStepsPerFrame) {
+
+    float actualDeltaT = updateStateByDeltaT( unsimulatedTime ); // advances at most safeTimeStep()
+    float stepDeltaT   = chosenDeltaT;
+
+    int numStalled = 0;
+
+    while (actualDeltaT < stepDeltaT) {
+      float deltaT = updateStateByDeltaT( stepDeltaT - actualDeltaT );
+      if (deltaT == 0 && ++numStalled > MAX_STALLED_CONTACTS * spheres.size())
+	break;
+      actualDeltaT += deltaT;
+    }
+
+    unsimulatedTime -= actualDeltaT;
+    nSteps++;
+  }
+
+  if (unsimulatedTime > 0) {
+    droppedTime += unsimulatedTime;
+    unsimulatedTime = 0;
+    overBudgetFrames++;
+  }
+
+  copyState( sphereState, prevState );  // nothing to interpolate
+}
+
+
+
+// The largest step that does not let any spheres pass through each
+// other or through a rectangle (conservative advancement): the
+// smallest gap between approaching objects found by the last
+// findCollisions(), divided by the fastest they could be closing.
+// That is twice the top sphere speed (for two spheres moving towards
+// each other), plus what gravity adds over a step (for a sphere
+// falling towards a rectangle or a sleeping sphere).
+//
+// The step is kept in [minAdaptiveStep, maxAdaptiveStep].  The lower
+// bound keeps a sphere resting on another from stopping the
+// simulation; any overlap it lets through is found at the end of the
+// step, as with fixed steps.  With ANALYTIC_TOI or EVENT_DRIVEN,
+// contacts are found at their exact times over any step, so only the
+// upper bound is needed.
+
+float World::safeTimeStep()
+
+{
+  if (collisionTime != BISECTION)
+    return maxAdaptiveStep;
+
+  float maxSpeed = 0;
+
+  for (int i=0; i<spheres.size(); i++)
+    if (!(sphereState.flags[i] & SPHERE_ASLEEP)) {
+      float speed = sphereState.velocity(i).length();
+      if (speed > maxSpeed)
+	maxSpeed = speed;
+    }
+
+  float closingSpeed = 2 * maxSpeed + GRAVITY_ACCEL.length() * maxAdaptiveStep;
+
+  float deltaT = (closestGap > 0 ? closestGap / closingSpeed : 0);
+
+  if (deltaT < minAdaptiveStep)
+    deltaT = minAdaptiveStep;
+  if (deltaT > maxAdaptiveStep)
+    deltaT = maxAdaptiveStep;
+
+  return deltaT;
+}
+
+
+
+// Sleeping spheres
+//
+// A sphere that is resting on its constraint rectangles, moving
+// slower than SLEEP_SPEED, with nothing approaching it, is put to
+// sleep.  Its velocity is set to zero, advance() puts it back where
+// it was, its constraints are not applied, and the collision searches
+// do not search from it: it is not tested against rectangles, and
+// its pairs with moving spheres are tested from the moving sphere.
+// So it is woken by a moving sphere coming within WAKE_DISTANCE of it
+// (as seen in its 'minDist' from the last collision search) or by a
+// collision.  It is still binned in the collision grids, which are
+// rebuilt every search, so that moving spheres can find it.
+
+void World::putToSleep( int i )
+
+{
+  sphereState.flags[i] |= SPHERE_ASLEEP;
+  sphereState.setVelocity( i, vec3(0,0,0) );
+  numAsleep++;
+}
+
+
+void World::wake( int i )
+
+{
+  if (sphereState.flags[i] & SPHERE_ASLEEP) {
+    sphereState.flags[i] &= ~SPHERE_ASLEEP;
+    numAsleep--;
+  }
+}
+
+
+void World::wakeApproachedSpheres()
+
+{
+  if (numAsleep == 0)
+    return;
+
+  for (int i=0; i<spheres.size(); i++)
+    if ((sphereState.flags[i] & SPHERE_ASLEEP) && (!allowSleeping || spheres[i].minDist < WAKE_DISTANCE))
+      wake( i );
+}
+
+
+
+// Apply sphere i's rolling constraints, as described in
+// updateStateByDeltaT().  A sleeping sphere already satisfies them and
+// cannot move off its rectangles, so is skipped.
+
+void World::applyConstraints( int i )
+
+{
+  if (!(sphereState.flags[i] & SPHERE_CONSTRAINED) || (sphereState.flags[i] & SPHERE_ASLEEP))
+    return;
+
+  vec3 x = sphereState.position(i); // position
+  vec3 v = sphereState.velocity(i); // velocity
+
+  for (int j=0; j<spheres[i].constraintRectangles.size(); j++) {
+    Rectangle &r = *(spheres[i].constraintRectangles[j]);
+
+    // Check for constraint removal
+
+    const RectangleFrame &frame = r.frame();
+
+    vec3 sphereCentre = frame.toLocal( x ); // now in coordinate system of rectangle
+
+    if (fabs(sphereCentre.x) > frame.halfX+RECTANGLE_EDGE_BUFFER ||
+	fabs(sphereCentre.y) > frame.halfY+RECTANGLE_EDGE_BUFFER) {
+
+      spheres[i].constraintRectangles.remove(j);
+#if 0
+      cout << "Removed s" << W2(i) << "-r" << W2(j) << " constraint" << endl;
+#endif
+      j--;
+      continue;
+    }
+
+    // Set position and velocity
+    
+    vec3 &n = r.normal;  // normal
+
+    v = v - (v*n)*n;  // Set normal velocity to zero
+    x = x - ((x - r.centre)*n - sphereState.radius[i])*n;  // Set normal position one sphere radius from rectangle
+  }
+
+  sphereState.setPosition( i, x );
+  sphereState.setVelocity( i, v );
+
+  if (spheres[i].constraintRectangles.size() == 0) {
+    sphereState.flags[i] &= ~SPHERE_CONSTRAINED;
+    wake( i );
+  }
+
+  // A sphere that has come to rest on its rectangles goes to sleep,
+  // unless something is approaching it
+
+  else if (allowSleeping && !(sphereState.flags[i] & SPHERE_ASLEEP) &&
+	   v.length() < SLEEP_SPEED && spheres[i].minDist >= WAKE_DISTANCE)
+    putToSleep( i );
+}
+
+
+
+// Advance the state by time deltaT, or to the first collision that
+// occurs.  If a collision occurs, resolve it and set the state to the
+// time just before the collision.
+
+float World::updateStateByDeltaT( float deltaT )
+
+{
+  numSteps++;
+
+  if (spheres.size() == 0) {
+    chosenDeltaT = deltaT;
+    return deltaT;
+  }
+
+  if (adaptiveTimeStep || collisionTime == EVENT_DRIVEN) {
+    float safeDeltaT = safeTimeStep();
+    if (deltaT > safeDeltaT)
+      deltaT = safeDeltaT;
+  }
+
+  chosenDeltaT = deltaT;
+
+  wakeApproachedSpheres();
+
+  // For spheres constrained to be rolling on rectangles, set the
+  // sphere velocity normal to the rectangle to be zero.  Also ensure
+  // that the sphere touches the rectangle and a single point.
+  //
+  // Also: Remove the constraint when the sphere moves off the
+  // rectangle.
+  //
+  // This is not very realistic, as there's no rolling.
+  
+  for (int i=0; i<spheres.size(); i++)
+    applyConstraints( i );
+
+  // With analytic TOI, go directly to the first contact instead of
+  // searching for it
+
+  if (collisionTime == ANALYTIC_TOI)
+    return advanceToFirstContact( deltaT );
+
+  // Or go from collision to collision
+
+  if (collisionTime == EVENT_DRIVEN)
+    return simulateEvents( deltaT );
+
+  // Collect start state.  The state vectors are kept in the World
+  // so that steps and binary-search probes do not allocate.
+
+  SphereStateArrays &yStart = stepStart;
+  SphereStateArrays &yEnd   = stepEnd;
+
+  copyState( sphereState, yStart );  // copy sphere states into state vector 'yStart'
+
+  if (localRewind) {
+    islandList.reserve( spheres.size() );
+    for (int w=0; w<pool->size(); w++)
+      islands[w].reserve( spheres.size() );
+  }
+
+  // Integrate
+  
+  bool collisionAtEnd;
+  Sphere *collisionSphere = NULL;
+  Object *collisionObject = NULL;
+
+  float actualDeltaT;
+
+  integrate( yStart, yEnd, deltaT, collisionAtEnd, &collisionSphere, &collisionObject );
+
+  if (!collisionAtEnd) {
+
+    // no collisions in this integration step.  We're done.
+
+    actualDeltaT = deltaT;
+    copyState( yEnd, sphereState );  // update sphere states and return
+
+  } else if (localRewind) {
+
+    // a collision: rewind and bisect only the spheres around it (see
+    // rewindIslands()).  Every sphere still gets to the end of the
+    // step.
+
+    rewindIslands( deltaT );
+
+    actualDeltaT = deltaT;
+
+  } else {
+
+    // a collision: Do binary seach until interval is at most
+    // MIN_DELTA_T_FOR_COLLISIONS.
+    //
+    // Once your search is complete, 'yStart' should contain the state
+    // at the start of the interval and 'yEnd' should contain the
+    // state at the end of the interval.  Call integrate() as
+    // necessary to get the end state from a given start state.
+    //
+    // Once the search is complete, 'actualDeltaT' should be the time
+    // to the start of the interval.  actualDeltaT is in (0,deltaT)
+    // and is the amount of time the simulation advances before the
+    // collision is arrived at.
+    //
+    // Read the code above to see how it can be determined that no
+    // collisions occur in an interval.
+    
+    actualDeltaT = 0;
+
+
+    // [YOUR CODE HERE]
+    float lower = 0, upper = deltaT, mid;
+    while (upper - lower > MIN_DELTA_T_FOR_COLLISIONS) {
+      mid = (lower + upper) / 2.0f;
+      integrate(yStart, yEnd, mid, collisionAtEnd, &collisionSphere, &collisionObject);
+      if (collisionAtEnd)
+        upper = mid;
+      else {
+        lower = mid;
+        copyState(yEnd, yStart);
+      }
+    }
+    actualDeltaT = lower;
+
+    // Set the sphere states to that at the START of the interval so
+    // that collision has not yet occurred.  Since the objects DO NOT
+    // MOVE during collision resolution, this ensures that the objects
+    // are not in collision immediately after the collision is
+    // resolved.  (In the contrary case, a new collision would be
+    // immediately detected, causing the simulation to stop advancing.)
+
+    copyState( yStart, sphereState );
+
+    // Resolve the collision, or with 'batchContacts', all the contacts
+    // found with it
+
+    if (batchContacts)
+      resolveContacts( contacts );
+    else
+      resolveCollision( collisionSphere, collisionObject );
+
+    // Debugging: report collision
+
+#if 0
+    bool otherIsSphere = (dynamic_cast<Sphere*>( collisionObject ) != NULL);
+    int i = sphereIndex( collisionSphere );
+    cout << "collision s" << W2(i) << "-";
+    if (otherIsSphere) {
+      int j = sphereIndex( dynamic_cast<Sphere*>( collisionObject ) );
+      vec3 dx = sphereState.position(i) - sphereState.position(j);
+      cout << "s" << W2(j)
+	   << ", relative speed " << (sphereState.velocity(i) - sphereState.velocity(j)) * dx.normalize()
+	   << ", relative position " << dx * dx.normalize()
+	   << endl;
+    } else {
+      Rectangle *r = dynamic_cast<Rectangle*>( collisionObject );
+      cout << "r" << W2(r - &rectangles[0])
+	   << ", relative speed " << sphereState.velocity(i) * r->normal
+	   << ", relative position " << (sphereState.position(i) - r->centre) * r->normal << endl;
+    }
+#endif
+
+  }
+
+  return actualDeltaT;
+}
+
+
+
+// Localized rewind
+//
+// With 'localRewind' set, a collision found at the end of a step does
+// not send the whole world back to the start of the step.  Only the
+// spheres that could have been involved in it are rewound: an
+// "island" of those that could have come into contact with a
+// colliding sphere during the step, those that could have come into
+// contact with them, and so on.  The island is then simulated on its
+// own clock, with bisection as in updateStateByDeltaT(), up to the end
+// of the step.  The other spheres keep their state at the end of the
+// step, which is exact for them, as nothing in the island could have
+// reached them.
+//
+// Every sphere left in contact by findCollisions() (with 'minDist' at
+// most zero) is put in an island.  No two islands can reach each other
+// during the step, so they are simulated in parallel, one per task on
+// the thread pool, and give the same result for any number of threads.
+// The end state is then searched again, in case a sphere gained more
+// speed in collisions than findIsland() allows for.  A sphere in a new
+// contact is put in an island again.  If that island reaches a sphere
+// that has already been rewound, it takes in the whole of that
+// sphere's island, and the merged island is simulated again from the
+// start of the step.  That is repeated until the only collisions left
+// are within an island already simulated.  Those are left to the next
+// step.  Each pass adds spheres to the islands or merges islands, so
+// the passes end.
+//
+// So every sphere advances by the whole step, and the cost of a
+// collision depends on the size of its island rather than on the
+// number of spheres.
+
+void World::rewindIslands( float deltaT )
+
+{
+  int nSpheres = spheres.size();
+
+  // Each sphere moves at most 'reach' over the step.  Twice the top
+  // speed allows for the speed a sphere can gain in a collision, which
+  // is at most 1 + |COEFF_OF_RESTITUTION| times that of the faster
+  // sphere.
+
+  float maxSpeed = 0;
+
+  for (int k=0; k<nSpheres; k++) {
+    float speed = stepStart.velocity(k).length();
+    if (speed > maxSpeed)
+      maxSpeed = speed;
+  }
+
+  float reach = 2 * maxSpeed * deltaT + GRAVITY_ACCEL.length() * deltaT * deltaT;
+
+  Sphere *collisionSphere;
+  Object *collisionObject;
+
+  do {
+
+    // Collect the islands
+
+    grid.build( stepStart.x, stepStart.y, stepStart.z, nSpheres, gridCellSize + 2 * reach );
+    islandList.endGrid.build( sphereState.x, sphereState.y, sphereState.z, nSpheres, gridCellSize );
+
+    islandList.n = 0;
+    islandList.start[0] = 0;
+    islandList.numPasses++;
+
+    for (int i=0; i<nSpheres; i++)
+      if (spheres[i].minDist <= 0 && islandList.passAdded[i] != islandList.numPasses &&
+	  (islandList.stepRewound[i] != numSteps || touchesOtherIsland( i )))
+	findIsland( i, reach );
+
+    if (islandList.n == 0)
+      break;
+
+    // Simulate them.  Each task takes islands from the list until
+    // there are none left.
+
+    islandList.deltaT = deltaT;
+    islandList.next = 0;
+
+    pool->run( pool->size(), simulateIslandsTask, this );
+
+  } while (findCollisions( &collisionSphere, &collisionObject ));
+}
+
+
+
+// Add the island of sphere i to 'islandList'.  Two spheres are in the
+// same island if their gap at the start of the step, in 'stepStart',
+// is at most 2 * reach, if they are in contact at the end of the step
+// (which a sphere that gained more speed than 'reach' allows for can
+// be from further away), or if they were in the same island earlier
+// in the step.  'grid' must be over 'stepStart' with cells 2 * reach
+// bigger than 'gridCellSize', and 'islandList.endGrid' over
+// 'sphereState'.
+
+void World::findIsland( int i, float reach )
+
+{
+  IslandList &list = islandList;
+
+  int first = list.start[ list.n ];
+  int end   = first;
+
+  joinIsland( i, end );
+
+  // Grow the island outwards from sphere i.  'members' is also the
+  // queue of spheres whose neighbours are still to be looked at.
+
+  int cells[27];
+
+  for (int m=first; m<end; m++) {
+
+    int k = list.members[m];
+    vec3 xk = stepStart.position(k);
+    int nCells = grid.neighbourCells( k, cells );
+
+    for (int c=0; c<nCells; c++)
+      for (int q=grid.cellStart(cells[c]); q<grid.cellEnd(cells[c]); q++) {
+
+	int l = grid.sphereAt(q);
+	if (list.passAdded[l] == list.numPasses)
+	  continue;
+
+	float gap = (stepStart.position(l) - xk).length() - sphereState.radius[k] - sphereState.radius[l];
+
+	if (gap <= 2 * reach)
+	  joinIsland( l, end );
+      }
+
+    nCells = list.endGrid.neighbourCells( k, cells );
+
+    for (int c=0; c<nCells; c++)
+      for (int q=list.endGrid.cellStart(cells[c]); q<list.endGrid.cellEnd(cells[c]); q++) {
+	int l = list.endGrid.sphereAt(q);
+	if (list.passAdded[l] != list.numPasses && inContactAtEnd( k, l ))
+	  joinIsland( l, end );
+      }
+  }
+
+  // Record the island for later passes
+
+  for (int m=first; m<end; m++) {
+    list.mate[ list.members[m] ] = list.members[ m+1 < end ? m+1 : first ];
+    list.root[ list.members[m] ] = i;
+  }
+
+  list.start[ ++list.n ] = end;
+}
+
+
+
+// Add sphere i to the island being found, which ends at 'end' in
+// 'islandList.members'.  If it was rewound earlier in the step, its
+// whole island from then comes with it.
+
+void World::joinIsland( int i, int &end )
+
+{
+  IslandList &list = islandList;
+
+  int k = i;
+
+  do {
+    list.members[end++] = k;
+    list.passAdded[k] = list.numPasses;
+    k = (list.stepRewound[k] == numSteps ? list.mate[k] : i);
+  } while (k != i);
+
+  list.stepRewound[i] = numSteps;
+}
+
+
+
+// Whether sphere i, which has been rewound in this step, is in contact
+// at the end of the step with a sphere from outside its island
+
+bool World::touchesOtherIsland( int i )
+
+{
+  IslandList &list = islandList;
+
+  int cells[27];
+  int nCells = list.endGrid.neighbourCells( i, cells );
+
+  for (int c=0; c<nCells; c++)
+    for (int q=list.endGrid.cellStart(cells[c]); q<list.endGrid.cellEnd(cells[c]); q++) {
+      int l = list.endGrid.sphereAt(q);
+      if (list.stepRewound[l] == numSteps && list.root[l] == list.root[i])  // (including l == i)
+	continue;
+      if (inContactAtEnd( i, l ))
+	return true;
+    }
+
+  return false;
+}
+
+
+
+// Whether spheres i and l are touching and approaching in 'sphereState'
+
+bool World::inContactAtEnd( int i, int l )
+
+{
+  vec3 d = sphereState.position(l) - sphereState.position(i);
+
+  return (l != i &&
+	  d.length() <= sphereState.radius[i] + sphereState.radius[l] &&
+	  (sphereState.velocity(l) - sphereState.velocity(i)) * d < 0);
+}
+
+
+
+// ThreadPool task: simulate islands from 'islandList' with the
+// worker's SphereIsland until there are none left
+
+void World::simulateIslandsTask( void *world, int worker )
+
+{
+  World *w = (World *) world;
+
+  IslandList   &list   = w->islandList;
+  SphereIsland &island = w->islands[worker];
+
+  int k;
+
+  while ((k = list.next++) < list.n) {
+
+    island.members = &list.members[ list.start[k] ];
+    island.n       = list.start[k+1] - list.start[k];
+
+    // Start from the state at the start of the step
+
+    island.start.resize( island.n );
+    island.end.resize( island.n );
+
+    for (int m=0; m<island.n; m++) {
+      int i = island.members[m];
+      island.start.setPosition( m, w->stepStart.position(i) );
+      island.start.setVelocity( m, w->stepStart.velocity(i) );
+      island.start.radius[m] = island.end.radius[m] = w->sphereState.radius[i];
+    }
+
+    w->copyIslandToWorld( island );
+    w->copyIslandFromWorld( island );  // (for the flags)
+
+    w->simulateIsland( island, list.deltaT );
+  }
+}
+
+
+
+// Simulate the island from the start of the step to deltaT, as
+// updateStateByDeltaT() does the whole world: integrate to the end,
+// and if there is a collision, bisect to find when, resolve it, and
+// carry on from there.  Only the members' entries in 'spheres' and
+// 'sphereState' are changed, so islands can be simulated in parallel.
+//
+// As in takeAdaptiveSteps(), a contact found again at the island's
+// start after it is resolved advances no time, so after
+// MAX_STALLED_CONTACTS per member the rest of the step is given up
+// and the island is left where it stalled.
+
+void World::simulateIsland( SphereIsland &island, float deltaT )
+
+{
+  SphereStateArrays &yStart = island.start;
+  SphereStateArrays &yEnd   = island.end;
+
+  float t = 0;  // the island's own time
+
+  int numStalled = 0;
+
+  while (t < deltaT) {
+
+    // Apply the members' constraints, which are kept in the World
+
+    copyIslandToWorld( island );
+
+    for (int m=0; m<island.n; m++)
+      applyConstraints( island.members[m] );
+
+    copyIslandFromWorld( island );
+
+    // Integrate
+
+    int  a, b;
+    bool bIsSphere;
+
+    float stepT = deltaT - t;
+
+    advanceIsland( yStart, yEnd, stepT );
+
+    if (!findIslandCollision( island, yEnd, &a, &b, &bIsSphere )) {
+      yStart.copyKinematics( yEnd );
+      break;
+    }
+
+    // Bisect.  Each probe starts from the latest state known to be
+    // before the collision.
+
+    float lower = 0, upper = stepT, mid;
+
+    while (upper - lower > MIN_DELTA_T_FOR_COLLISIONS) {
+      mid = (lower + upper) / 2.0f;
+      advanceIsland( yStart, yEnd, mid - lower );
+      if (findIslandCollision( island, yEnd, &a, &b, &bIsSphere ))
+	upper = mid;
+      else {
+	lower = mid;
+	yStart.copyKinematics( yEnd );
+      }
+    }
+
+    t += lower;
+
+    // Resolve the collision in the state just before it
+
+    copyIslandToWorld( island );
+
+    if (batchContacts)
+      resolveContacts( island.contacts );
+    else if (bIsSphere)
+      resolveCollision( &spheres[ island.members[a] ], &spheres[ island.members[b] ] );
+    else
+      resolveCollision( &spheres[ island.members[a] ], &rectangles[b] );
+
+    copyIslandFromWorld( island );
+
+    if (lower == 0 && ++numStalled > MAX_STALLED_CONTACTS * island.n)
+      break;
+  }
+
+  copyIslandToWorld( island );
+}
+
+
+
+// As advance(), for the island, without changing 'sphereState'
+
+void World::advanceIsland( SphereStateArrays &yStart, SphereStateArrays &yEnd, float deltaT )
+
+{
+  integrator->step( yStart, yEnd, deltaT, GRAVITY_ACCEL );
+
+  for (int m=0; m<yStart.n; m++)
+    if (yStart.flags[m] & SPHERE_ASLEEP) {
+      yEnd.setPosition( m, yStart.position(m) );
+      yEnd.setVelocity( m, yStart.velocity(m) );
+    }
+}
+
+
+
+// As findCollisions(), for the island's spheres in state 's', which
+// can only collide with each other and with rectangles.  The
+// colliding sphere and other object are returned as indices in the
+// island and in 'rectangles'.  With 'batchContacts', all the contacts
+// are kept in the island's 'contacts' if there is a collision.
+// Drawing distances are not updated.
+
+bool World::findIslandCollision( SphereIsland &island, SphereStateArrays &s, int *sphere, int *other, bool *otherIsSphere )
+
+{
+  SphereGrid &grid = island.grid;
+
+  grid.build( s.x, s.y, s.z, s.n, gridCellSize );
+
+  float minDist = FLT_MAX;
+  int cells[27];
+
+  island.found.clear();
+
+  // Sphere/sphere
+
+  for (int m=0; m<s.n; m++) {
+
+    if (s.flags[m] & SPHERE_ASLEEP)  // (tested from the awake spheres)
+      continue;
+
+    int nCells = grid.neighbourCells( m, cells );
+    int nCandidates = 0;
+
+    for (int c=0; c<nCells; c++)
+      for (int q=grid.cellStart(cells[c]); q<grid.cellEnd(cells[c]); q++) {
+	int l = grid.sphereAt(q);
+	if (l > m || (s.flags[l] & SPHERE_ASLEEP))
+	  island.candidates[nCandidates++] = l;
+      }
+
+    approachDistances( s, m, island.candidates, nCandidates, island.candidateDist );
+
+    for (int k=0; k<nCandidates; k++) {
+
+      if (batchContacts && island.candidateDist[k] <= 0)
+	island.found.add( island.members[m], island.members[ island.candidates[k] ], true );
+
+      if (island.candidateDist[k] < minDist) {  // (NOT_APPROACHING is FLT_MAX)
+	minDist = island.candidateDist[k];
+	*sphere = m;
+	*other = island.candidates[k];
+	*otherIsSphere = true;
+      }
+    }
+  }
+
+  // Sphere/rectangle, except with constraining rectangles
+
+  for (int m=0; m<s.n; m++) {
+
+    if (s.flags[m] & SPHERE_ASLEEP)
+      continue;
+
+    Sphere &sph = spheres[ island.members[m] ];
+
+    for (int j=0; j<rectangles.size(); j++)
+      if (!(s.flags[m] & SPHERE_CONSTRAINED) || ! sph.constraintRectangles.exists( &rectangles[j] )) {
+
+	vec3 x = s.position(m);
+
+	vec3 contactPoint;
+	float dist = Sphere::distToRectangle( x, s.radius[m], rectangles[j], &contactPoint );
+
+	float relativeVelocitySign = (((x - rectangles[j].centre) * rectangles[j].normal) * rectangles[j].normal) * s.velocity(m);
+
+	if (relativeVelocitySign < 0) {
+
+	  if (batchContacts && dist <= 0)
+	    island.found.add( island.members[m], j, false );
+
+	  if (dist < minDist) {
+	    minDist = dist;
+	    *sphere = m;
+	    *other = j;
+	    *otherIsSphere = false;
+	  }
+	}
+      }
+  }
+
+  if (batchContacts && minDist <= 0) {
+    island.contacts.clear();
+    island.contacts.append( island.found );
+  }
+
+  return (minDist <= 0);
+}
+
+
+
+// Copy the island's start state to its members in 'sphereState'
+
+void World::copyIslandToWorld( SphereIsland &island )
+
+{
+  for (int m=0; m<island.n; m++) {
+    int k = island.members[m];
+    sphereState.setPosition( k, island.start.position(m) );
+    sphereState.setVelocity( k, island.start.velocity(m) );
+  }
+}
+
+
+
+// Copy the members' state from 'sphereState' to the island's start
+// state.  Their flags, which collisions and constraints change in
+// 'sphereState', are copied to the end state too.
+
+void World::copyIslandFromWorld( SphereIsland &island )
+
+{
+  for (int m=0; m<island.n; m++) {
+    int k = island.members[m];
+    island.start.setPosition( m, sphereState.position(k) );
+    island.start.setVelocity( m, sphereState.velocity(k) );
+    island.start.flags[m] = island.end.flags[m] = sphereState.flags[k];
+  }
+}
+
+
+
+// Make room for islands of all n spheres, so that islands do not
+// allocate.  The islands are recorded afresh.
+
+void IslandList::reserve( int nSpheres )
+
+{
+  if (nSpheres > capacity) {
+    delete [] members;
+    delete [] start;
+    delete [] stepRewound;
+    delete [] mate;
+    delete [] root;
+    delete [] passAdded;
+    capacity    = nSpheres;
+    members     = new int[ capacity ];
+    start       = new int[ capacity+1 ];
+    stepRewound = new long[ capacity ];
+    mate        = new int[ capacity ];
+    root        = new int[ capacity ];
+    passAdded   = new long[ capacity ];
+    for (int i=0; i<capacity; i++)
+      stepRewound[i] = passAdded[i] = -1;
+    endGrid.reserve( capacity );
+  }
+}
+
+
+
+// Make room for an island of all n spheres
+
+void SphereIsland::reserve( int nSpheres )
+
+{
+  if (nSpheres > capacity) {
+    delete [] candidates;
+    delete [] candidateDist;
+    capacity      = nSpheres;
+    candidates    = new int[ capacity ];
+    candidateDist = new float[ capacity ];
+    start.resize( capacity );
+    end.resize( capacity );
+    grid.reserve( capacity );
+    found.reserve( capacity );
+    contacts.reserve( capacity );
+  }
+}
+
+
+
+// Advance the state by time deltaT, or to the first contact, which is
+// found analytically by findFirstContact().  If there is a contact,
+// resolve it at the time of contact.
+//
+// This costs one prediction pass and one integration step per
+// contact, instead of the log2(deltaT/MIN_DELTA_T_FOR_COLLISIONS)
+// integrations and collision searches of the binary search, and the
+// contact time is exact rather than to within
+// MIN_DELTA_T_FOR_COLLISIONS.
+
+float World::advanceToFirstContact( float deltaT )
+
+{
+  Sphere *collisionSphere = NULL;
+  Object *collisionObject = NULL;
+
+  float tContact = findFirstContact( deltaT, &collisionSphere, &collisionObject );
+
+  float actualDeltaT = (tContact == NO_CONTACT ? deltaT : tContact);
+
+  SphereStateArrays &yStart = stepStart;
+  SphereStateArrays &yEnd   = stepEnd;
+
+  copyState( sphereState, yStart );
+  advance( yStart, yEnd, actualDeltaT );
+
+  if (tContact != NO_CONTACT)
+    resolveCollision( collisionSphere, collisionObject );
+
+  return actualDeltaT;
+}
+
+
+
+// Whether sphere pair (i,j) comes before pair (bestI,bestJ), for
+// breaking ties between equally close pairs as a serial search over
+// i and then j would
+
+static bool pairBefore( int i, int j, int bestI, int bestJ )
+
+{
+  return i < bestI || (i == bestI && j < bestJ);
+}
+
+
+
+// Find the earliest contact between a sphere and another sphere or a
+// rectangle within time deltaT.  Return its time, or NO_CONTACT if
+// there is none.
+//
+// Each sphere is predicted to follow the path of the integrator's step
+// (see Integrator::pathAccelFactor()).  For explicit Euler this is a
+// straight line at the starting velocity, so every contact time is the
+// root of a quadratic.  The other integrators give parabolas.  These
+// are the same for all moving spheres, so contacts between two moving
+// spheres and with rectangle faces are still quadratics, but contacts
+// with a sleeping sphere (which does not move) or with rectangle
+// edges and corners need the numerical quartic solver.
+//
+// As with findCollisions(), each sphere's 'minDist' and
+// 'contactPoint' are set for drawing.
+
+float World::findFirstContact( float deltaT, Sphere **collisionSphere, Object **collisionObject )
+
+{
+  int nSpheres = spheres.size();
+
+  vec3 pathAccel = pathAccelFactor() * GRAVITY_ACCEL;
+  vec3 noAccel( 0, 0, 0 );
+
+  float maxSpeed = 0;
+
+  for (int i=0; i<nSpheres; i++) {
+    spheres[i].minDist = FLT_MAX;
+    float speed = sphereState.velocity(i).length();
+    if (speed > maxSpeed)
+      maxSpeed = speed;
+  }
+
+  float tFirst = NO_CONTACT;
+
+  // Sphere/sphere contacts.  Use grid cells large enough that spheres
+  // which can meet within deltaT are in neighbouring cells.
+
+  float maxMove = maxSpeed * deltaT + 0.5f * pathAccel.length() * deltaT * deltaT;
+
+  grid.build( sphereState.x, sphereState.y, sphereState.z, nSpheres, gridCellSize + 2 * maxMove );
+
+  int bestI = -1, bestJ = -1;
+  int cells[27];
+
+  for (int i=0; i<nSpheres; i++) {
+
+    // As in findSphereCollisionsInGrid(), pairs with a sleeping sphere
+    // are tested from the awake one
+
+    if (sphereState.flags[i] & SPHERE_ASLEEP)
+      continue;
+
+    vec3 xi = sphereState.position(i);
+    vec3 vi = sphereState.velocity(i);
+    int nCells = grid.neighbourCells( i, cells );
+
+    for (int c=0; c<nCells; c++)
+      for (int k=grid.cellStart(cells[c]); k<grid.cellEnd(cells[c]); k++) {
+
+	int j = grid.sphereAt(k);
+	unsigned int asleep = sphereState.flags[j] & SPHERE_ASLEEP;
+	if (j <= i && !asleep)
+	  continue;
+
+	vec3 xj = sphereState.position(j);
+	vec3 vj = sphereState.velocity(j);
+
+	vec3 aj = (asleep ? noAccel : pathAccel);
+
+	float t = sphereSphereTOI( xi, vi, pathAccel, sphereState.radius[i],
+				   xj, vj, aj, sphereState.radius[j], deltaT );
+
+	int lo = (i < j ? i : j);
+	int hi = (i < j ? j : i);
+
+	if (t < tFirst || (t == tFirst && pairBefore( lo, hi, bestI, bestJ ))) {
+	  tFirst = t;
+	  bestI = lo;
+	  bestJ = hi;
+	}
+
+	vec3 centreToCentre = xj - xi;
+
+	if ((vj - vi) * centreToCentre < 0) {
+
+	  float dist = centreToCentre.length() - sphereState.radius[i] - sphereState.radius[j];
+
+	  if (dist < spheres[i].minDist) {
+	    spheres[i].minDist = dist;
+	    spheres[i].contactPoint = xi + 0.5 * centreToCentre;
+	  }
+
+	  if (dist < spheres[j].minDist) {
+	    spheres[j].minDist = dist;
+	    spheres[j].contactPoint = xi + 0.5 * centreToCentre;
+	  }
+	}
+      }
+  }
+
+  if (bestI >= 0) {
+    *collisionSphere = &spheres[bestI];
+    *collisionObject = &spheres[bestJ];
+  }
+
+  // Sphere/rectangle contacts, except with constraining rectangles
+
+  for (int i=0; i<nSpheres; i++) {
+
+    if (sphereState.flags[i] & SPHERE_ASLEEP)  // (not moving)
+      continue;
+
+    for (int j=0; j<rectangles.size(); j++) 
+      if (!(sphereState.flags[i] & SPHERE_CONSTRAINED) || ! spheres[i].constraintRectangles.exists( &rectangles[j] )) {
+
+	vec3 x = sphereState.position(i);
+	vec3 v = sphereState.velocity(i);
+	float radius = sphereState.radius[i];
+
+	Rectangle &r = rectangles[j];
+
+	// As in findCollisions(), the sphere must be approaching the
+	// rectangle's plane, since that is the direction in which
+	// resolveCollision() changes its velocity.  On a curved path it
+	// may only start approaching later in the interval.
+
+	vec3 planeSide = ((x - r.centre) * r.normal) * r.normal;
+
+	if (planeSide * v >= 0 && planeSide * (v + deltaT * pathAccel) >= 0)
+	  continue;
+
+	vec3 contactPoint;
+
+	float t = sphereRectangleTOI( x, v, pathAccel, radius, r, deltaT, &contactPoint );
+
+	if (t == NO_CONTACT)
+	  continue;
+
+	if (t < tFirst) {
+	  tFirst = t;
+	  *collisionSphere = &spheres[i];
+	  *collisionObject = &rectangles[j];
+	}
+
+	float dist = (contactPoint - x).length() - radius;
+
+	if (dist < spheres[i].minDist) {
+	  spheres[i].minDist = dist;
+	  spheres[i].contactPoint = contactPoint;
+	}
+      }
+  }
+
+  return tFirst;
+}
+
+
+
+// Contacts are predicted along the path of an integration step, or
+// along the exact path with EVENT_DRIVEN, which does not integrate.
+
+float World::pathAccelFactor()
+
+{
+  return (collisionTime == EVENT_DRIVEN ? 1 : integrator->pathAccelFactor());
+}
+
+
+
+// Event-driven simulation
+//
+// Advance the state by time deltaT by jumping from collision to
+// collision, as in event-driven molecular dynamics.  Between
+// collisions each sphere follows its exact path
+//
+//   x(t) = x + v t + 1/2 a t^2
+//
+// for its own acceleration 'a' (gravity, less the components into its
+// constraint rectangles, or zero if asleep).  Each moving sphere's
+// earliest contact with a neighbour or a rectangle is predicted
+// analytically and put in the 'events' queue.  The earliest event is
+// taken from the queue and resolved, and only the two objects in it
+// are predicted again.  Events predicted before either sphere's last
+// collision are discarded as they come out of the queue.
+//
+// A sphere's entry in 'sphereState' is only moved forward to the
+// current time when it is in a collision or is needed for a
+// prediction, so the cost of a collision does not depend on the
+// number of spheres.  All spheres are brought to the end time before
+// returning.
+//
+// Sleeping spheres are not predicted, since they do not move until
+// something hits them, which the other sphere's prediction finds.
+//
+// The neighbours of each sphere come from a grid built at the start,
+// with cells large enough for the spheres' movement over deltaT at the
+// speeds they had then.  To keep the neighbourhoods small, deltaT is
+// cut so that no sphere moves more than MAX_EVENT_MOVE cells.  If a
+// collision speeds a sphere up so that it could leave its
+// neighbourhood, or there are more than MAX_EVENTS_PER_SPHERE
+// collisions per sphere (as when a sphere is squeezed between others),
+// this stops early and returns the time reached.  The next call, with
+// a new grid, continues from there.
+//
+// Constraints are updated and spheres are put to sleep by
+// updateStateByDeltaT() before each call, so not between collisions.
+
+float World::simulateEvents( float deltaT )
+
+{
+  int nSpheres = spheres.size();
+
+  eventState.reserve( nSpheres );
+  events.reserve( 4 * nSpheres );
+  events.clear();
+
+  // Grid cells that hold each sphere's neighbours over deltaT.
+  // 'stepStart' keeps the positions from which the grid was built.
+
+  float maxSpeed = 0;
+
+  for (int i=0; i<nSpheres; i++) {
+
+    eventState.time[i] = 0;
+    eventState.accel[i] = sphereAccel( i );
+    eventState.numCollisions[i] = 0;
+
+    spheres[i].minDist = FLT_MAX;
+
+    float speed = sphereState.velocity(i).length();
+    if (speed > maxSpeed)
+      maxSpeed = speed;
+  }
+
+  // Go no further than fast spheres can move in a fraction of a cell,
+  // so that the neighbourhoods stay small
+
+  if (maxSpeed * deltaT > MAX_EVENT_MOVE * gridCellSize)
+    deltaT = MAX_EVENT_MOVE * gridCellSize / maxSpeed;
+
+  float g = GRAVITY_ACCEL.length();
+  float maxMove = maxSpeed * deltaT + 0.5f * g * deltaT * deltaT;
+
+  grid.build( sphereState.x, sphereState.y, sphereState.z, nSpheres, gridCellSize + 2 * maxMove );
+
+  copyState( sphereState, stepStart );
+
+  // Predict the first events
+
+  for (int i=0; i<nSpheres; i++)
+    if (!(sphereState.flags[i] & SPHERE_ASLEEP))
+      predictEvent( i, 0, deltaT );
+
+  // Resolve events in order
+
+  float now = 0;
+  long  nCollisions = 0;
+  bool  stop = false;
+
+  while (!events.empty() && !stop) {
+
+    Event e = events.removeFirst();
+
+    int i = e.sphere;
+    int j = e.other;
+
+    if (e.sphereCount != eventState.numCollisions[i])  // sphere i was predicted again since
+      continue;
+
+    if (e.otherIsSphere && e.otherCount != eventState.numCollisions[j]) {  // sphere j has changed its path
+      predictEvent( i, e.time, deltaT );
+      continue;
+    }
+
+    now = e.time;
+
+    moveSphereTo( i, now );
+    if (e.otherIsSphere)
+      moveSphereTo( j, now );
+
+    if (e.otherIsSphere)
+      resolveCollision( &spheres[i], &spheres[j] );
+    else
+      resolveCollision( &spheres[i], &rectangles[j] );
+
+    numSteps++;
+    nCollisions++;
+
+    // Update the spheres' paths, which are no longer those that other
+    // spheres' predictions were made with.  If a sphere could now move
+    // beyond its grid neighbourhood, stop here.
+
+    int nInvolved = (e.otherIsSphere ? 2 : 1);
+
+    for (int k=0; k<nInvolved; k++) {
+
+      int s = (k == 0 ? i : j);
+
+      eventState.accel[s] = sphereAccel( s );
+      eventState.numCollisions[s]++;
+
+      float tLeft = deltaT - now;
+      float reach = (sphereState.position(s) - stepStart.position(s)).length()
+	+ sphereState.velocity(s).length() * tLeft + 0.5f * g * tLeft * tLeft;
+
+      if (reach > maxMove)
+	stop = true;
+    }
+
+    if (nCollisions >= (long) MAX_EVENTS_PER_SPHERE * nSpheres)
+      stop = true;
+
+    if (!stop) {
+      predictEvent( i, now, deltaT );
+      if (e.otherIsSphere)
+	predictEvent( j, now, deltaT );
+    }
+  }
+
+  float tEnd = (stop ? now : deltaT);
+
+  for (int i=0; i<nSpheres; i++)
+    moveSphereTo( i, tEnd );
+
+  return tEnd;
+}
+
+
+
+// Acceleration of sphere i along its path: gravity, without the
+// components into the rectangles that it is constrained to
+
+vec3 World::sphereAccel( int i )
+
+{
+  if (sphereState.flags[i] & SPHERE_ASLEEP)
+    return vec3( 0, 0, 0 );
+
+  vec3 a = GRAVITY_ACCEL;
+
+  if (sphereState.flags[i] & SPHERE_CONSTRAINED)
+    for (int j=0; j<spheres[i].constraintRectangles.size(); j++) {
+      vec3 &n = spheres[i].constraintRectangles[j]->normal;
+      a = a - (a*n)*n;
+    }
+
+  return a;
+}
+
+
+
+// Move sphere i's entry in 'sphereState' along its path to time t
+
+void World::moveSphereTo( int i, float t )
+
+{
+  float dt = t - eventState.time[i];
+
+  if (dt == 0)
+    return;
+
+  vec3 a = eventState.accel[i];
+  vec3 v = sphereState.velocity(i);
+
+  sphereState.setPosition( i, sphereState.position(i) + dt * v + (0.5f * dt * dt) * a );
+  sphereState.setVelocity( i, v + dt * a );
+
+  eventState.time[i] = t;
+}
+
+
+
+// Predict the first contact of sphere i after time 'now' and before
+// tEnd, and add it to the event queue.  As in findFirstContact(), the
+// sphere's and its neighbours' 'minDist' and 'contactPoint' are set
+// for drawing.
+
+void World::predictEvent( int i, float now, float tEnd )
+
+{
+  moveSphereTo( i, now );
+
+  vec3 xi = sphereState.position(i);
+  vec3 vi = sphereState.velocity(i);
+  vec3 ai = eventState.accel[i];
+  float ri = sphereState.radius[i];
+
+  float tMax = tEnd - now;
+
+  Event e;
+  e.time = NO_CONTACT;
+
+  // Sphere/sphere contacts
+
+  int cells[27];
+  int nCells = grid.neighbourCells( i, cells );
+
+  for (int c=0; c<nCells; c++)
+    for (int k=grid.cellStart(cells[c]); k<grid.cellEnd(cells[c]); k++) {
+
+      int j = grid.sphereAt(k);
+      if (j == i)
+	continue;
+
+      moveSphereTo( j, now );
+
+      vec3 xj = sphereState.position(j);
+      vec3 vj = sphereState.velocity(j);
+
+      float t = sphereSphereTOI( xi, vi, ai, ri,
+				 xj, vj, eventState.accel[j], sphereState.radius[j], tMax );
+
+      if (t < e.time || (t == e.time && e.otherIsSphere && j < e.other)) {
+	e.time = t;
+	e.other = j;
+	e.otherIsSphere = true;
+      }
+
+      vec3 centreToCentre = xj - xi;
+
+      if ((vj - vi) * centreToCentre < 0) {
+
+	float dist = centreToCentre.length() - ri - sphereState.radius[j];
+
+	if (dist < spheres[i].minDist) {
+	  spheres[i].minDist = dist;
+	  spheres[i].contactPoint = xi + 0.5 * centreToCentre;
+	}
+
+	if (dist < spheres[j].minDist) {
+	  spheres[j].minDist = dist;
+	  spheres[j].contactPoint = xi + 0.5 * centreToCentre;
+	}
+      }
+    }
+
+  // Sphere/rectangle contacts, except with constraining rectangles
+
+  for (int j=0; j<rectangles.size(); j++)
+    if (!(sphereState.flags[i] & SPHERE_CONSTRAINED) || ! spheres[i].constraintRectangles.exists( &rectangles[j] )) {
+
+      Rectangle &r = rectangles[j];
+
+      vec3 planeSide = ((xi - r.centre) * r.normal) * r.normal;
+
+      if (planeSide * vi >= 0 && planeSide * (vi + tMax * ai) >= 0)  // not approaching, as in findFirstContact()
+	continue;
+
+      vec3 contactPoint;
+
+      float t = sphereRectangleTOI( xi, vi, ai, ri, r, tMax, &contactPoint );
+
+      if (t == NO_CONTACT)
+	continue;
+
+      // resolveCollision() only changes the velocity normal to the
+      // rectangle's plane, so a contact with an edge that the sphere
+      // is not approaching the plane at would be found again at once.
+      // It is left to the next call, as in findCollisions().
+
+      if (planeSide * (vi + t * ai) >= 0)
+	continue;
+
+      if (t < e.time) {
+	e.time = t;
+	e.other = j;
+	e.otherIsSphere = false;
+      }
+
+      float dist = (contactPoint - xi).length() - ri;
+
+      if (dist < spheres[i].minDist) {
+	spheres[i].minDist = dist;
+	spheres[i].contactPoint = contactPoint;
+      }
+    }
+
+  if (e.time == NO_CONTACT)
+    return;
+
+  e.time += now;
+  e.sphere = i;
+  e.sphereCount = eventState.numCollisions[i];
+  e.otherCount = (e.otherIsSphere ? eventState.numCollisions[e.other] : 0);
+
+  events.add( e );
+}
+
+
+
+// If there was a collision over time deltaT, use binary search to
+// find the time of collision (to within MIN_DELTA_T_FOR_COLLISIONS)
+// and set yEnd to the state just BEFORE that collision.
+//
+// The spheres are split into chunks that are searched in parallel.
+// Each chunk finds its own closest pairs, and its own closest
+// distance to each sphere, which are then combined in chunk order.
+// Since the chunks are consecutive ranges of spheres, this picks the
+// same pairs (and contact points) as a serial search, whatever the
+// number of threads.
+
+
+bool World::findCollisions( Sphere **collisionSphere, Object **collisionObject )
+
+{
+  int nSpheres = spheres.size();
+
+  if (broadphase == UNIFORM_GRID)
+    grid.build( sphereState.x, sphereState.y, sphereState.z, nSpheres, gridCellSize );
+
+  setupChunks( nSpheres );
+
+  // Check for sphere/sphere collisions.  Then set each sphere's min
+  // distance (used for drawing lines to closest object) from those
+  // found by the chunks.
+
+  pool->run( numChunks, sphereCollisionTask, this );
+  pool->run( numChunks, mergeClosestTask, this );
+
+  // Check for sphere/rectangle collisions
+
+  pool->run( numChunks, rectangleCollisionTask, this );
+
+  // Pick the closest pair.  Sphere/sphere pairs come before
+  // sphere/rectangle pairs.  Ties between sphere/sphere pairs go to the
+  // lowest (i,j), and between sphere/rectangle pairs to the earlier
+  // chunk, as in a serial search.
+
+  float minDist = FLT_MAX;
+  int   bestC   = -1;
+
+  for (int c=0; c<numChunks; c++)
+    if (chunks[c].sphereMinDist < minDist ||
+	(chunks[c].sphereMinDist == minDist && bestC >= 0 &&
+	 pairBefore( chunks[c].sphereI, chunks[c].sphereJ, chunks[bestC].sphereI, chunks[bestC].sphereJ ))) {
+      minDist = chunks[c].sphereMinDist;
+      bestC = c;
+    }
+
+  if (bestC >= 0) {
+    *collisionSphere = &spheres[ chunks[bestC].sphereI ];
+    *collisionObject = &spheres[ chunks[bestC].sphereJ ];
+  }
+
+  for (int c=0; c<numChunks; c++)
+    if (chunks[c].rectangleMinDist < minDist) {
+      minDist = chunks[c].rectangleMinDist;
+      *collisionSphere = &spheres[ chunks[c].rectangleI ];
+      *collisionObject = &rectangles[ chunks[c].rectangleJ ];
+    }
+
+  closestGap = minDist;
+
+  // Keep all the contacts, in chunk order, if there was a collision
+
+  if (batchContacts && minDist <= 0) {
+    contacts.clear();
+    for (int c=0; c<numChunks; c++)
+      contacts.append( chunks[c].contacts );
+  }
+
+  return (minDist <= 0);
+}
+
+
+
+// Split the spheres into chunks for findCollisions(): one per thread,
+// unless there are too few spheres to be worth it.
+
+void World::setupChunks( int nSpheres )
+
+{
+  numChunks = nSpheres / MIN_SPHERES_PER_CHUNK;
+
+  if (numChunks > pool->size())
+    numChunks = pool->size();
+  if (numChunks < 1)
+    numChunks = 1;
+
+  for (int c=0; c<numChunks; c++) {
+    CollisionChunk &chunk = chunks[c];
+    chunk.start = (int) ((long) c * nSpheres / numChunks);
+    chunk.end   = (int) ((long) (c+1) * nSpheres / numChunks);
+    chunk.reserve( nSpheres );
+    if (batchContacts)
+      chunk.contacts.reserve( nSpheres );  // usually enough
+  }
+
+  if (batchContacts)
+    contacts.reserve( nSpheres );
+}
+
+
+void World::sphereCollisionTask( void *world, int c )
+
+{
+  World *w = (World *) world;
+
+  if (w->broadphase == UNIFORM_GRID)
+    w->findSphereCollisionsInGrid( w->chunks[c] );
+  else
+    w->findSphereCollisionsBruteForce( w->chunks[c] );
+}
+
+
+void World::mergeClosestTask( void *world, int c )
+
+{
+  World *w = (World *) world;
+
+  w->mergeClosest( w->chunks[c] );
+}
+
+
+void World::rectangleCollisionTask( void *world, int c )
+
+{
+  World *w = (World *) world;
+
+  w->findRectangleCollisions( w->chunks[c] );
+}
+
+
+
+// Sphere/sphere part of findCollisions(), over all pairs (i,j), i !=
+// j, for the chunk's spheres i.  Only sphere i's closest distance is
+// updated.
+
+void World::findSphereCollisionsBruteForce( CollisionChunk &chunk )
+
+{
+  int nSpheres = spheres.size();
+
+  for (int i=0; i<nSpheres; i++)
+    chunk.minDist[i] = FLT_MAX;
+
+  chunk.sphereMinDist = FLT_MAX;
+  chunk.contacts.clear();
+
+  // The candidates for sphere i are all j != i, so list all spheres
+  // and pass the ranges before and after i.
+
+  for (int j=0; j<nSpheres; j++)
+    chunk.candidates[j] = j;
+
+  for (int i=chunk.start; i<chunk.end; i++) {
+
+    approachDistances( sphereState, i, chunk.candidates, i, chunk.candidateDist );
+    approachDistances( sphereState, i, chunk.candidates+i+1, nSpheres-i-1, chunk.candidateDist+i+1 );
+
+    for (int j=0; j<nSpheres; j++) 
+      if (i != j) {
+
+	float dist = chunk.candidateDist[j];
+
+	if (dist != NOT_APPROACHING) { // coming together
+
+	  if (batchContacts && dist <= 0 && i < j)
+	    chunk.contacts.add( i, j, true );
+
+	  if (dist < chunk.sphereMinDist) {
+	    chunk.sphereMinDist = dist;
+	    chunk.sphereI = i;
+	    chunk.sphereJ = j;
+	  }
+
+	  if (dist < chunk.minDist[i]) {
+	    chunk.minDist[i] = dist;
+	    chunk.contactPoint[i] = sphereState.position(i) + 0.5 * (sphereState.position(j) - sphereState.position(i));
+	  }
+	}
+      }
+  }
+}
+
+
+
+// Sphere/sphere part of findCollisions() using the uniform grid.
+//
+// Each pair in neighbouring cells is tested once and updates both
+// spheres.  The pair chosen is the same as with BRUTE_FORCE: the
+// closest approaching pair, with ties going to the lowest (i,j).
+//
+// A sleeping sphere is not moving, so it is not searched from:  its
+// pairs with awake spheres are tested from the awake sphere, and two
+// sleeping spheres cannot be approaching.  So an awake sphere i is
+// tested against the awake j > i and against all the sleeping j, and
+// a sleeping sphere i costs only its flag test.
+
+void World::findSphereCollisionsInGrid( CollisionChunk &chunk )
+
+{
+  int nSpheres = spheres.size();
+
+  for (int i=0; i<nSpheres; i++)
+    chunk.minDist[i] = FLT_MAX;
+
+  chunk.sphereMinDist = FLT_MAX;
+  chunk.contacts.clear();
+
+  int bestI = -1, bestJ = -1;
+  int cells[27];
+
+  for (int i=chunk.start; i<chunk.end; i++) {
+
+    // Collect the candidates from the neighbouring cells, then find
+    // their distances together
+
+    if (sphereState.flags[i] & SPHERE_ASLEEP)
+      continue;
+
+    int nCells = grid.neighbourCells( i, cells );
+    int nCandidates = 0;
+
+    for (int c=0; c<nCells; c++)
+      for (int k=grid.cellStart(cells[c]); k<grid.cellEnd(cells[c]); k++) {
+	int j = grid.sphereAt(k);
+	if (j > i || (sphereState.flags[j] & SPHERE_ASLEEP))
+	  chunk.candidates[nCandidates++] = j;
+      }
+
+    approachDistances( sphereState, i, chunk.candidates, nCandidates, chunk.candidateDist );
+
+    vec3 xi = sphereState.position(i);
+
+    for (int k=0; k<nCandidates; k++) {
+
+      int j = chunk.candidates[k];
+      float dist = chunk.candidateDist[k];
+
+      if (dist != NOT_APPROACHING) { // coming together
+
+	vec3 centreToCentre = sphereState.position(j) - xi;
+
+	int lo = (i < j ? i : j);
+	int hi = (i < j ? j : i);
+
+	if (batchContacts && dist <= 0)
+	  chunk.contacts.add( lo, hi, true );
+
+	if (dist < chunk.sphereMinDist || (dist == chunk.sphereMinDist && pairBefore( lo, hi, bestI, bestJ ))) {
+	  chunk.sphereMinDist = dist;
+	  bestI = lo;
+	  bestJ = hi;
+	}
+
+	if (dist < chunk.minDist[i]) {
+	  chunk.minDist[i] = dist;
+	  chunk.contactPoint[i] = xi + 0.5 * centreToCentre;
+	}
+
+	if (dist < chunk.minDist[j]) {
+	  chunk.minDist[j] = dist;
+	  chunk.contactPoint[j] = xi + 0.5 * centreToCentre;
+	}
+      }
+    }
+  }
+
+  chunk.sphereI = bestI;
+  chunk.sphereJ = bestJ;
+}
+
+
+
+// Set the min distance and contact point of the chunk's spheres to
+// the closest found by any chunk.  Ties go to the earlier chunk.
+
+void World::mergeClosest( CollisionChunk &chunk )
+
+{
+  for (int i=chunk.start; i<chunk.end; i++) {
+
+    spheres[i].minDist = FLT_MAX;
+
+    for (int c=0; c<numChunks; c++)
+      if (chunks[c].minDist[i] < spheres[i].minDist) {
+	spheres[i].minDist = chunks[c].minDist[i];
+	spheres[i].contactPoint = chunks[c].contactPoint[i];
+      }
+  }
+}
+
+
+
+// Sphere/rectangle part of findCollisions(), for the chunk's spheres
+//
+// However, do not check against rectangles that a sphere is constrained to remain in contact with.
+//
+// Sleeping spheres are not moving, so are not checked.
+
+void World::findRectangleCollisions( CollisionChunk &chunk )
+
+{
+  chunk.rectangleMinDist = FLT_MAX;
+
+  for (int i=chunk.start; i<chunk.end; i++) {
+
+    if (sphereState.flags[i] & SPHERE_ASLEEP)
+      continue;
+
+    for (int j=0; j<rectangles.size(); j++) 
+      if (!(sphereState.flags[i] & SPHERE_CONSTRAINED) || ! spheres[i].constraintRectangles.exists( &rectangles[j] )) { // skip constraining rectangles
+
+	vec3 x = sphereState.position(i);
+
+	vec3 contactPoint;
+	float dist = Sphere::distToRectangle( x, sphereState.radius[i], rectangles[j], &contactPoint );
+
+	float relativeVelocitySign = (((x - rectangles[j].centre) * rectangles[j].normal) * rectangles[j].normal) * sphereState.velocity(i);
+
+	if (relativeVelocitySign < 0) { // < 0 if coming together, > 0 is moving apart
+
+	  if (batchContacts && dist <= 0)
+	    chunk.contacts.add( i, j, false );
+
+	  if (dist < chunk.rectangleMinDist) {
+	    chunk.rectangleMinDist = dist;
+	    chunk.rectangleI = i;
+	    chunk.rectangleJ = j;
+	  }
+
+	  if (dist < spheres[i].minDist) {
+	    spheres[i].minDist = dist;
+	    spheres[i].contactPoint = contactPoint;
+	  }
+	}
+      }
+  }
+}
+
+
+
+void ContactList::reserve( int newCapacity )
+
+{
+  if (newCapacity <= capacity)
+    return;
+
+  Contact *newContact = new Contact[ newCapacity ];
+
+  for (int k=0; k<n; k++)
+    newContact[k] = contact[k];
+
+  delete [] contact;
+  contact = newContact;
+  capacity = newCapacity;
+}
+
+
+void ContactList::grow()
+
+{
+  reserve( capacity > 0 ? 2 * capacity : 64 );
+}
+
+
+void ContactList::append( const ContactList &list )
+
+{
+  for (int k=0; k<list.n; k++)
+    add( list.contact[k].sphere, list.contact[k].other, list.contact[k].otherIsSphere );
+}
+
+
+
+// Make room for the results of n spheres
+
+void CollisionChunk::reserve( int n )
+
+{
+  if (n > capacity) {
+    delete [] minDist;
+    delete [] contactPoint;
+    delete [] candidates;
+    delete [] candidateDist;
+    capacity      = n;
+    minDist       = new float[ capacity ];
+    contactPoint  = new vec3[ capacity ];
+    candidates    = new int[ capacity ];
+    candidateDist = new float[ capacity ];
+  }
+}
+
+
+
+// Make room for n spheres
+
+void SphereEventState::reserve( int n )
+
+{
+  if (n > capacity) {
+    delete [] time;
+    delete [] accel;
+    delete [] numCollisions;
+    capacity      = n;
+    time          = new float[ capacity ];
+    accel         = new vec3[ capacity ];
+    numCollisions = new int[ capacity ];
+  }
+}
+
+
+
+// Resolve the contacts found with a collision, in 'list', by
+// sequential impulses: sweep through them, resolving each one whose
+// objects are still approaching, until none are or MAX_CONTACT_SWEEPS
+// sweeps have been made.  A collision that pushes a sphere into
+// another that it is touching is then passed on at once, rather than
+// being found by another bisection in the next step.  The state must
+// be that just before the collision.
+
+void World::resolveContacts( ContactList &list )
+
+{
+  for (int sweep=0; sweep<MAX_CONTACT_SWEEPS; sweep++) {
+
+    bool resolved = false;
+
+    for (int k=0; k<list.n; k++) {
+
+      Contact &c = list.contact[k];
+
+      int  i  = c.sphere;
+      vec3 xi = sphereState.position(i);
+      vec3 vi = sphereState.velocity(i);
+
+      if (c.otherIsSphere) {
+
+	int j = c.other;
+
+	if ((vi - sphereState.velocity(j)) * (xi - sphereState.position(j)) >= 0)  // not approaching
+	  continue;
+
+	resolveCollision( &spheres[i], &spheres[j] );
+
+      } else {
+
+	Rectangle &r = rectangles[c.other];
+
+	if ((((xi - r.centre) * r.normal) * r.normal) * vi >= 0)  // not approaching
+	  continue;
+
+	if ((sphereState.flags[i] & SPHERE_CONSTRAINED) && spheres[i].constraintRectangles.exists( &r ))  // constrained by an earlier sweep
+	  continue;
+
+	resolveCollision( &spheres[i], &r );
+      }
+
+      resolved = true;
+    }
+
+    if (!resolved)
+      break;
+  }
+}
+
+
+
+// Resolve a collision between a sphere and another object.  The other
+// object can be a sphere or a rectangle.  Rectangles are immovable.
+
+void World::resolveCollision( Sphere *sphere, Object *otherObject )
+
+{
+  numCollisions++;
+
+  // Extract the collision object as a sphere or rectangle
+  
+  bool otherIsSphere = (dynamic_cast<Sphere*>(otherObject) != NULL);
+
+  if (otherIsSphere) {
+
+    // SPHERE/SPHERE COLLISION
+
+    Sphere *sphere2 = dynamic_cast<Sphere*>(otherObject);
+
+    int i1 = sphereIndex( sphere );
+    int i2 = sphereIndex( sphere2 );
+
+    wake( i1 );
+    wake( i2 );
+
+    vec3 v1 = sphereState.velocity( i1 );
+    vec3 v2 = sphereState.velocity( i2 );
+
+    // [YOUR CODE HERE: REPLACE THE CODE BELOW]
+    
+    // Find a normal to the tangent plane between the spheres
+
+    vec3 n = (sphereState.position( i1 ) - sphereState.position( i2 )).normalize();
+
+    // Find the velocity in the normal direction after the collisions
+
+    float v1b = v1 * n; // sphere 1 velocity before in normal direction
+    float v2b = v2 * n; // sphere 2 velocity before in normal direction
+
+    float m1 = sphere->mass();  // sphere 1 mass
+    float m2 = sphere2->mass();  // sphere 2 mass
+  
+    float v1a = (m1 * v1b + m2 * v2b + COEFF_OF_RESTITUTION * m2 * (v2b - v1b)) / (m1 + m2); // sphere 1 velocity AFTER in normal direction
+    float v2a = (m1 * v1b + m2 * v2b + COEFF_OF_RESTITUTION * m1 * (v1b - v2b)) / (m1 + m2); // sphere 2 velocity AFTER in normal direction
+
+    // An integrator whose step accelerates the spheres along their
+    // paths (see Integrator::pathAccelFactor()) can bring slowly
+    // separating spheres back into contact before the collision
+    // search can see them apart, and the simulation would stop
+    // advancing.  So separate them at least fast enough to stay apart
+    // for MIN_DELTA_T_FOR_COLLISIONS, if only one of them accelerates.
+    // (Explicit Euler steps are straight lines, so need no minimum.)
+    //
+    // That adds no energy to a contact that closed faster.  A resting
+    // contact, which closed slower, gains up to 1/2 m
+    // minSeparatingSpeed^2, so it is separated only with
+    // 'separateRestingContacts'.
+
+    float minSeparatingSpeed = pathAccelFactor() * GRAVITY_ACCEL.length() * MIN_DELTA_T_FOR_COLLISIONS;
+
+    bool resting = (v2b - v1b < minSeparatingSpeed);
+
+    if (minSeparatingSpeed > 0 && v1a - v2a < minSeparatingSpeed && (separateRestingContacts || !resting)) {
+      float dv = minSeparatingSpeed - (v1a - v2a);
+      v1a += dv * m2 / (m1 + m2);
+      v2a -= dv * m1 / (m1 + m2);
+    }
+
+    // Update sphere velocities in 'sphereState'
+    vec3 v1_tangent = v1 - (v1b * n);  // sphere 1 tangential velocity
+    vec3 v2_tangent = v2 - (v2b * n); // sphere 2 tangential velocity
+    sphereState.setVelocity( i1, v1_tangent + (v1a * n) );  // sphere 1 velocity AFTER
+    sphereState.setVelocity( i2, v2_tangent + (v2a * n) );  // sphere 2 velocity AFTER
+
+    // [END OF YOUR CODE ABOVE]
+
+  } else {
+
+    // SPHERE/RECTANGLE COLLISION
+
+    Rectangle *rectangle = dynamic_cast<Rectangle*>(otherObject);
+
+    int i1 = sphereIndex( sphere );
+
+    vec3 v1 = sphereState.velocity( i1 );
+
+    // [YOUR CODE HERE: REPLACE THE CODE BELOW]
+    
+    // Find tangent plane normal
+    //
+    // Be careful to consider when the sphere hits the edge or corner
+    // of the rectangle, as the plane in these cases is NOT the plane
+    // of the rectangle.
+
+    vec3 n = rectangle->normal;;
+    
+    // Find the velocity in the normal direction after the collisions
+
+    float v1b = v1 * n; // sphere velocity before in normal direction
+    float v2b = 0; // rectangle velocity before in normal direction
+
+    float m1 = sphere->mass();  // sphere mass
+
+    float m2 = 1e6;  // rectangle mass.  NOTE THAT THIS MASS IS VERY
+		      // LARGE AND CAN BE USED AS IF THE RECTANGLE IS
+		      // A MOVING OBJECT.  DO THIS!  See rectangle.h
+  
     float v1a = (m1 * v1b + m2 * v2b + COEFF_OF_RESTITUTION * m2 * (v2b - v1b)) / (m1 + m2); // sphere velocity AFTER in normal direction
 
+    // As for two spheres, leave fast enough to stay apart, on
+    // whichever side of the rectangle the sphere is
+
+    float minSeparatingSpeed = pathAccelFactor() * GRAVITY_ACCEL.length() * MIN_DELTA_T_FOR_COLLISIONS;
+
+    float side = ((sphereState.position( i1 ) - rectangle->centre) * n >= 0 ? 1 : -1);
+
+    bool resting = (-side * v1b < minSeparatingSpeed);
+
+    if (minSeparatingSpeed > 0 && side * v1a < minSeparatingSpeed && (separateRestingContacts || !resting))
+      v1a = side * minSeparatingSpeed;
+
+    // A sphere bouncing on a rectangle under gravity makes a series of
+    // ever shorter bounces, each of which would be another collision.
+    // With accel 'a' towards the plane, a bounce at normal speed v
+    // lasts 2v/a and the next is at speed |COEFF_OF_RESTITUTION| v, so
+    // all the rest take
+    //
+    //   2 v / (a (1 - |COEFF_OF_RESTITUTION|))
+    //
+    // If that is short, and the sphere is on the plane, skip them:
+    // stop it in the normal direction now, so that it is constrained
+    // to the plane below.  The bounces do not change its tangential
+    // velocity, so it ends up where it would have after them.
+
+    float accelToPlane = -(GRAVITY_ACCEL * n);
+    float planeGap     = (sphereState.position( i1 ) - rectangle->centre) * n - sphereState.radius[i1];
+
+    if (restZenoBounces && side > 0 && accelToPlane > 0 && fabs(planeGap) < MIN_NORMAL_DISTANCE &&
+	2 * v1a / (accelToPlane * (1 - fabs(COEFF_OF_RESTITUTION))) < ZENO_REST_TIME)
+      v1a = 0;
+
     // Update state of sphere velocity only.  Do not change velocity of rectangle.
-    vec3 v1_tangent = sphere->state.v - (v1b * n);
-    sphere->state.v  = v1_tangent + (v1a * n);  // sphere velocity AFTER
+    vec3 v1_tangent = v1 - (v1b * n);
+    sphereState.setVelocity( i1, v1_tangent + (v1a * n) );  // sphere velocity AFTER
 
     // [END OF YOUR CODE ABOVE]
 
@@ -576,10 +2661,11 @@ void World::resolveCollision( Sphere *sphere, Object *otherObject )
     //
     // Note that a sphere could be constrained to multiple planes.
 
-    float distToPlane = (sphere->state.x - rectangle->centre) * rectangle->normal - sphere->radius;
+    float distToPlane = (sphereState.position( i1 ) - rectangle->centre) * rectangle->normal - sphereState.radius[i1];
 
     if (fabs(distToPlane) < MIN_NORMAL_DISTANCE && fabs(v1a) < MIN_NORMAL_SPEED) {
       sphere->constraintRectangles.add( rectangle );
+      sphereState.flags[i1] |= SPHERE_CONSTRAINED;
 #if 0
       cout << "Added   s" << W2(sphere - &spheres[0]) << "-r" << W2(rectangle - &rectangles[0]) << " constraint" << endl;
 #endif
@@ -589,6 +2675,8 @@ void World::resolveCollision( Sphere *sphere, Object *otherObject )
 
 
 
+#ifndef HEADLESS
+
 // Draw the world
 
 void World::draw( mat4 WCS_to_VCS, mat4 VCS_to_CCS, vec3 &lightDir )
@@ -596,14 +2684,24 @@ void World::draw( mat4 WCS_to_VCS, mat4 VCS_to_CCS, vec3 &lightDir )
 {
   vec3 lightRed( 0.984, 0.322, 0.220 );   // free sphere
   vec3 greenish( 0.105, 0.700, 0.305 );   // sphere constrained to rectangle
+  vec3 yellow(   0.969, 0.863, 0.216 );   // selected sphere
 
   vec3 cerulean(  0.608, 0.769, 0.886 );  // pit sides and ground
   vec3 deeperCerulean = 0.8 * cerulean;   // pit bottom
 
-  // Draw spheres
-  
+  // Draw spheres, all in one instanced draw call
+
+  if (sphereRenderer == NULL)
+    sphereRenderer = new SphereRenderer( SPHERE_LEVELS );
+
+  sphereRenderer->clear();
+
+  int selected = sphereSlots.index( selectedSphere );
+
   for (int i=0; i<spheres.size(); i++)
-    spheres[i].draw( WCS_to_VCS, VCS_to_CCS, lightDir, (spheres[i].constraintRectangles.size() == 0 ? lightRed : greenish) );
+    sphereRenderer->add( spheres[i].state.x, spheres[i].radius, (i == selected ? yellow : spheres[i].constraintRectangles.size() == 0 ? lightRed : greenish) );
+
+  sphereRenderer->draw( WCS_to_VCS, VCS_to_CCS, lightDir );
 
   // Draw rectangles
   
@@ -614,21 +2712,23 @@ void World::draw( mat4 WCS_to_VCS, mat4 VCS_to_CCS, vec3 &lightDir )
 
   if (showClosest) {
     
-    vec3 *segments = new vec3[ 2 * spheres.size() ];
+    if (closestSegsCapacity < 2 * spheres.size()) {
+      delete [] closestSegs;
+      closestSegsCapacity = 2 * spheres.size();
+      closestSegs = new vec3[ closestSegsCapacity ];
+    }
+
     int n = 0;
   
     for (int i=0; i<spheres.size(); i++)
       if (spheres[i].minDist != FLT_MAX) {
-	segments[n++] = spheres[i].state.x;
-	segments[n++] = spheres[i].contactPoint;
+	closestSegs[n++] = spheres[i].state.x;
+	closestSegs[n++] = spheres[i].contactPoint;
       }
 
     mat4 MVP = VCS_to_CCS * WCS_to_VCS;
-    segs->drawSegs( GL_LINES, segments, vec3( 0.75, 0.9, 0.1 ), NULL, n, WCS_to_VCS, MVP, lightDir );
-
-    // Clean up
-    
-    delete [] segments;
+    segs->drawSegs( GL_LINES, closestSegs, vec3( 0.75, 0.9, 0.1 ), NULL, n, WCS_to_VCS, MVP, lightDir );
   }
 }
 
+#endif
@@ -6,25 +6,418 @@
 #include "sphere.h"
 #include "rectangle.h"
 #include "seq.h"
+#include "grid.h"
+#include "sphereState.h"
+#include "sphereSlots.h"
+#include "threadPool.h"
+#include "integrator.h"
+#include "eventQueue.h"
 
 
 
-#define SPHERE_LEVELS 3  // number of times sphere is refined from original dodecahedron.
+#define SPHERE_LEVELS 3  // number of times the sphere mesh is refined from the original icosahedron
+
+class SphereRenderer;
 
 #define WORLD_RADIUS 6
 
 
+typedef enum { BRUTE_FORCE, UNIFORM_GRID } BroadphaseType; // how sphere/sphere pairs are found in findCollisions()
+
+typedef enum { BISECTION, ANALYTIC_TOI, EVENT_DRIVEN } CollisionTimeType; // how the time of a collision is found in updateStateByDeltaT()
+
+
+// A list of contacts between a sphere and another sphere or a
+// rectangle.  The array grows by doubling and is kept between uses,
+// so it stops allocating once it is large enough.
+
+class Contact {
+
+ public:
+
+  int  sphere;         // index of the sphere
+  int  other;          // index of the other sphere or rectangle
+  bool otherIsSphere;
+};
+
+
+class ContactList {
+
+  void grow();
+
+ public:
+
+  Contact *contact;
+  int      n;
+  int      capacity;
+
+  ContactList() {
+    contact = NULL;
+    n = 0;
+    capacity = 0;
+  }
+
+  ~ContactList() {
+    delete [] contact;
+  }
+
+  void reserve( int n );  // make room for n contacts
+  void clear() { n = 0; }
+
+  void add( int sphere, int other, bool otherIsSphere ) {
+    if (n == capacity)
+      grow();
+    contact[n].sphere = sphere;
+    contact[n].other = other;
+    contact[n].otherIsSphere = otherIsSphere;
+    n++;
+  }
+
+  void append( const ContactList &list );
+};
+
+
+// Results of one chunk of spheres in findCollisions(): the closest
+// pairs among those tested, and the closest distance to each sphere
+// from the sphere/sphere pairs tested.
+
+class CollisionChunk {
+
+ public:
+
+  int start, end;  // spheres [start,end)
+
+  float sphereMinDist;  // closest approaching sphere/sphere pair
+  int   sphereI, sphereJ;
+
+  float rectangleMinDist;  // closest approaching sphere/rectangle pair
+  int   rectangleI, rectangleJ;
+
+  float *minDist;       // per sphere
+  vec3  *contactPoint;
+
+  ContactList contacts;  // approaching pairs that touch, if World::batchContacts is set
+
+  int   *candidates;     // scratch: candidates of one sphere
+  float *candidateDist;  // and their distances, from approachDistances()
+  int    capacity;
+
+  CollisionChunk() {
+    capacity = 0;
+    minDist = candidateDist = NULL;
+    contactPoint = NULL;
+    candidates = NULL;
+  }
+
+  ~CollisionChunk() {
+    delete [] minDist;
+    delete [] contactPoint;
+    delete [] candidates;
+    delete [] candidateDist;
+  }
+
+  void reserve( int n );
+};
+
+
+// Per-sphere state of the event-driven simulation in
+// simulateEvents().  Each sphere's entry in 'sphereState' is at its
+// own time, and is only brought forward when needed.
+
+class SphereEventState {
+
+ public:
+
+  float *time;           // time of the sphere's entry in 'sphereState'
+  vec3  *accel;          // acceleration until its next collision
+  int   *numCollisions;  // since the start of simulateEvents()
+  int    capacity;
+
+  SphereEventState() {
+    capacity = 0;
+    time = NULL;
+    accel = NULL;
+    numCollisions = NULL;
+  }
+
+  ~SphereEventState() {
+    delete [] time;
+    delete [] accel;
+    delete [] numCollisions;
+  }
+
+  void reserve( int n );
+};
+
+
+// The islands of spheres that are simulated apart from the others for
+// the rest of a step, when collisions are found with 'localRewind' set
+// (see rewindIslands()).  No sphere is in more than one island.
+//
+// 'members' and 'start' hold the islands of one pass of
+// rewindIslands().  'mate' and 'root' remember, for the rest of the
+// step, which island each rewound sphere was last simulated in, so
+// that a later island that reaches it can take in the whole island.
+// 'endGrid' is over the state at the end of the pass, for finding the
+// spheres that are in contact then.
+
+class IslandList {
+
+ public:
+
+  int  *members;      // indices in World::spheres of the members of all islands, island by island
+  int  *start;        // n+1 entries: start of each island in 'members'
+  int   n;            // number of islands
+  long *stepRewound;  // per sphere in World::spheres: value of numSteps when it was last in an island
+  int  *mate;         // per sphere: next member of its island, in a ring (if stepRewound is this step)
+  int  *root;         // per sphere: first member of its island (likewise)
+  long *passAdded;    // per sphere: value of numPasses when it was last put in an island
+  long  numPasses;    // passes of rewindIslands() so far
+  int   capacity;
+
+  SphereGrid endGrid;
+
+  float deltaT;            // time to the end of the step
+  std::atomic<int> next;   // next island to be simulated
+
+  IslandList() {
+    n = 0;
+    capacity = 0;
+    numPasses = 0;
+    members = start = mate = root = NULL;
+    stepRewound = passAdded = NULL;
+  }
+
+  ~IslandList() {
+    delete [] members;
+    delete [] start;
+    delete [] stepRewound;
+    delete [] mate;
+    delete [] root;
+    delete [] passAdded;
+  }
+
+  void reserve( int nSpheres );
+};
+
+
+// One island being simulated, with the scratch space to simulate it.
+// There is one of these per worker thread.
+
+class SphereIsland {
+
+ public:
+
+  int *members;  // indices in World::spheres, in IslandList::members
+  int  n;        // number of members
+
+  SphereStateArrays start, end;  // state of the members, in 'members' order
+
+  SphereGrid grid;  // over the members
+
+  int   *candidates;     // scratch: candidates of one sphere
+  float *candidateDist;  // and their distances, from approachDistances()
+  int    capacity;
+
+  ContactList found;     // scratch: contacts found by findIslandCollision()
+  ContactList contacts;  // from its last call that found a collision, with World::batchContacts
+
+  SphereIsland() {
+    n = 0;
+    capacity = 0;
+    members = NULL;
+    candidates = NULL;
+    candidateDist = NULL;
+  }
+
+  ~SphereIsland() {
+    delete [] candidates;
+    delete [] candidateDist;
+  }
+
+  void reserve( int nSpheres );
+};
+
+
 class World {
 
   seq<Sphere> spheres;
   seq<Rectangle> rectangles;
 
+  SphereSlots sphereSlots;  // handle slots of the spheres; see sphereSlots.h
+
+  SphereStateArrays sphereState;  // positions and velocities used by the physics; index i is spheres[i]
+
+  SphereStateArrays prevState;  // sphereState at the start of the last step of updateState(), for drawing
+
+  SphereStateArrays stepStart, stepEnd;  // scratch state vectors for updateStateByDeltaT(), reused between steps
+
   static const SphereDef    initSpheres[];
   static const RectangleDef initRectangles[];
 
+  SphereGrid grid;
+  float      gridCellSize;  // at least the largest sphere diameter
+
+  void setGridCellSize();
+  void initSphereState();
+  void copyStateToSpheres( float alpha );
+
+  int sphereIndex( Sphere *sphere ) {
+    return sphere - &spheres[0];
+  }
+
+  void addSphere( float radius, vec3 centre );
+  void removeFallenSpheres();
+  void moveSphere( int from, int to );
+  void truncateSpheres( int n );
+
+  ThreadPool     *pool;
+  CollisionChunk *chunks;     // pool->size() of these
+  int             numChunks;  // number in use
+
+  void setupChunks( int nSpheres );
+  void findSphereCollisionsBruteForce( CollisionChunk &chunk );
+  void findSphereCollisionsInGrid( CollisionChunk &chunk );
+  void mergeClosest( CollisionChunk &chunk );
+  void findRectangleCollisions( CollisionChunk &chunk );
+
+  static void sphereCollisionTask( void *world, int chunk );  // ThreadPool tasks
+  static void mergeClosestTask( void *world, int chunk );
+  static void rectangleCollisionTask( void *world, int chunk );
+
+  SphereRenderer *sphereRenderer;  // draws the spheres; set up on the first draw()
+
+  vec3 *closestSegs;          // endpoints of the 'showClosest' lines, kept between frames
+  int   closestSegsCapacity;
+
+  Integrator *integrator;  // used by advance()
+
+  std::atomic<int> numAsleep;  // spheres with SPHERE_ASLEEP set (changed by islands on worker threads)
+
+  float unsimulatedTime;  // simulated time not yet stepped through, less than timeStep between frames
+
+  float closestGap;  // between approaching objects, from the last findCollisions()
+
+  float chosenDeltaT;  // step chosen by the last updateStateByDeltaT(), before a collision cut it short
+
+  void  takeFixedSteps();
+  void  takeAdaptiveSteps();
+  float safeTimeStep();
+
+  void applyConstraints( int i );
+
+  void putToSleep( int i );
+  void wake( int i );
+  void wakeApproachedSpheres();
+
+  float findFirstContact( float deltaT, Sphere **collisionSphere, Object **collisionObject );
+  float advanceToFirstContact( float deltaT );
+
+  IslandList    islandList;  // used by rewindIslands()
+  SphereIsland *islands;     // pool->size() of these
+
+  void rewindIslands( float deltaT );
+  void findIsland( int i, float reach );
+  void joinIsland( int i, int &end );
+  bool touchesOtherIsland( int i );
+  bool inContactAtEnd( int i, int l );
+  void simulateIsland( SphereIsland &island, float deltaT );
+  void advanceIsland( SphereStateArrays &yStart, SphereStateArrays &yEnd, float deltaT );
+  bool findIslandCollision( SphereIsland &island, SphereStateArrays &s, int *sphere, int *other, bool *otherIsSphere );
+  void copyIslandToWorld( SphereIsland &island );
+  void copyIslandFromWorld( SphereIsland &island );
+
+  static void simulateIslandsTask( void *world, int worker );
+
+  float pathAccelFactor();  // of the paths along which contacts are predicted
+
+  ContactList contacts;  // from the last findCollisions() that found a collision, with 'batchContacts'
+
+  void resolveContacts( ContactList &list );
+
+  EventQueue       events;      // used by simulateEvents()
+  SphereEventState eventState;
+
+  float simulateEvents( float deltaT );
+  vec3  sphereAccel( int i );
+  void  moveSphereTo( int i, float t );
+  void  predictEvent( int i, float now, float tEnd );
+
  public:
 
+  long numSteps; // number of calls to updateStateByDeltaT(), plus collisions with EVENT_DRIVEN (for throughput measurements)
+
+  BroadphaseType broadphase; // UNIFORM_GRID by default; BRUTE_FORCE is the O(n^2) reference
+
+  CollisionTimeType collisionTime; // BISECTION by default
+
+  std::atomic<long> numCollisions; // resolved by resolveCollision() (for throughput measurements)
+
+  bool allowSleeping; // true by default: resting spheres are put to sleep
+
+  bool restZenoBounces; // true by default: a sphere whose bounces on a rectangle would die out within ZENO_REST_TIME is put to rest at once
+
+  bool separateRestingContacts; // true by default: a resting contact is given the separating speed that keeps integrators whose paths accelerate from stalling on it, which adds a little energy (see resolveCollision())
+
+  bool sweptCollisions; // false by default: if true, BISECTION without localRewind also finds contacts along the spheres' paths, not just overlaps at the end of a step
+
+  bool batchContacts; // false by default: if true, BISECTION resolves all contacts found at the time of a collision together
+
+  bool localRewind; // false by default: if true, a collision found by BISECTION only rewinds the spheres that could be involved in it, and simulates them on the worker threads
+
+  float timeStep;         // time of one integration step in updateState()
+  int   maxStepsPerFrame; // most steps taken by one updateState() call
+  long  overBudgetFrames; // number of updateState() calls that hit maxStepsPerFrame and dropped time
+  float droppedTime;      // simulated time dropped by those calls
+
+  bool  adaptiveTimeStep; // false by default: if true, updateStateByDeltaT() chooses its own steps
+  float minAdaptiveStep;  // within these bounds, instead of using 'timeStep'
+  float maxAdaptiveStep;
+
   World( char *sphereFilename );
+  ~World();
+
+  void setIntegrator( IntegratorType type );  // EXPLICIT_EULER by default
+
+  IntegratorType integratorType() {
+    return integrator->type();
+  }
+
+  void setNumThreads( int n );  // for findCollisions() and local rewinds; 0 means one per core
+
+  int numThreads() {
+    return pool->size();
+  }
+
+  void writeSpheres( const char *filename );
+
+  int numSpheres() {
+    return spheres.size();
+  }
+
+  // Spheres are packed, so removing one moves others to new indices
+  // and invalidates Sphere pointers.  A SphereHandle stays valid.
+
+  SphereHandle sphereHandle( int i ) {
+    return sphereSlots.handle( i );
+  }
+
+  Sphere *sphere( SphereHandle h ) {  // NULL if the sphere has been removed
+    int i = sphereSlots.index( h );
+    return (i < 0 ? NULL : &spheres[i]);
+  }
+
+  void removeSphere( SphereHandle h );
+
+  SphereHandle selectedSphere;  // drawn highlighted while it exists; none at first
+
+  void selectNextSphere();
+
+  int numSleeping() {
+    return numAsleep;
+  }
+
+  float totalEnergy();  // kinetic plus gravitational potential, of the spheres
 
   void updateState( float elapsedTime );
 
@@ -33,22 +426,12 @@ class World {
   void draw( mat4 WCS_to_VCS, mat4 VCS_to_CCS, vec3 &lightDir );
   quaternion orientationDeriv( quaternion q, vec3 w );
   bool findCollisions( Sphere **collisionSphere, Object **collisionObject );
-  void integrate( State *yStart, State *yEnd, float deltaT, bool &collisionAtEnd, Sphere **collsionSphere, Object **collisionObject );
+  void integrate( SphereStateArrays &yStart, SphereStateArrays &yEnd, float deltaT, bool &collisionAtEnd, Sphere **collsionSphere, Object **collisionObject );
+  void advance( SphereStateArrays &yStart, SphereStateArrays &yEnd, float deltaT );
   void resolveCollision( Sphere *collisionSphere, Object *collisionObject );
 
-  void copyState( Sphere *fromSpheres, State *toState ) {
-    for (int i=0; i<spheres.size(); i++)
-      toState[i] = fromSpheres[i].state;
-  }
-
-  void copyState( State *fromState, Sphere *toSpheres ) {
-    for (int i=0; i<spheres.size(); i++)
-      toSpheres[i].state = fromState[i];
-  }
-
-  void copyState( State *fromState, State *toState ) {
-    for (int i=0; i<spheres.size(); i++)
-      toState[i] = fromState[i];
+  void copyState( SphereStateArrays &fromState, SphereStateArrays &toState ) {
+    toState.copyKinematics( fromState );
   }
   
 };